@@ -2,189 +2,217 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
+#include "hex.h"
+#include "libhex.h"
 #include "directives.h"
 #include "grid.h"
-#include "hex.h"
-
-extern game_t game, first_game;
-Listptr first_move = NULL, last_move = NULL;
-
-clock_t timer;
-double max_time; /* Time limit for each move */
+#include "history.h"
+#include "journal.h"
+#include "network.h"
+#include "pcache.h"
+#include "solver.h"
+#include "openings.h"
+
+#define ANALYSIS_SLICE 1000 /* Nodes the analysis searches between checks for stop and reports */
+
+/* The analysis started by analyze, run by a thread of its own on a copy of the engine */
+static struct {
+  hex_engine *engine;
+  pthread_t thread;
+  pthread_mutex_t pause; /* Held by the analysis for each slice, and by calibrate_level() to pause it */
+  double interval; /* Seconds between two reports */
+  bool running; /* Until the thread is joined */
+  bool stop;
+} analysis = {.pause = PTHREAD_MUTEX_INITIALIZER};
+
+/* The nodes per second searched on each size of grid, once calibrate() has measured it (-1 if it */
+/* couldn't be measured) */
+static double search_speed[MAX_DIMENSION+1];
+
+/* Prints the grid after a directive has changed it, unless boards are turned off (-q) */
+static void show_grid(void) {
+  if(!engine->quiet)
+    print_grid();
+}
 
-/* Processes a directive */
-void process(char **directive) {
-  int err_encountered; /* Determines error type, if one occurs */
+/* Processes a directive, returning TRUE if it ended the current player's turn (a move was */
+/* played or a new game was started), or else FALSE, once the player to move has been printed */
+bool process(char **directive) {
+  int err_encountered = NO_ERROR; /* Determines error type, if one occurs */
   int dir_ind; /* Current directive index */
-  
+  bool turn_over = FALSE;
+
   Move current_move;
-  static bool swap_occured = FALSE;
+  char move[MAX_MOVE_STR];
 
-  switch(dir_ind = get_index(directive)) {
+  /* The analysis goes on until a directive that may change the game (or the engine) is given */
+  dir_ind = get_index(directive);
+  if(dir_ind != SHOWSTATE && dir_ind != SAVE && dir_ind != LEVEL && dir_ind != STOP && dir_ind != -1)
+    stop_analysis();
+
+  switch(dir_ind) {
     case NEWGAME:
-      if((err_encountered = newgame(directive))) {
-        print_error(err_encountered);
-        print_current_player();
-        dealloc_char(MAX_WORDS, directive);
-        process(next_directive());
-      }
-      else {
-        delete_move_list(&first_move);
-        first_move = last_move = NULL;
-        dealloc_char(MAX_WORDS, directive);
-        print_grid();
+      if(!(err_encountered = newgame(directive))) {
+        calibrate_level();
+        history_clear();
+        journal_game();
+        show_grid();
+        turn_over = TRUE;
       }
       break;
 
     case PLAY:
-      if((err_encountered = play(directive, &current_move))) {
-        print_error(err_encountered);
-        print_current_player();
-        dealloc_char(MAX_WORDS, directive);
-        process(next_directive());
-      }
-      else {
-        print_grid();
-        printf("Move played: %c%d\n", current_move.col+'A' ,current_move.row+1);
-        dealloc_char(MAX_WORDS, directive);
+      if(!(err_encountered = play(directive, &current_move))) {
+        journal_append(JL_MOVE, game.current_player, 0, current_move.row, current_move.col);
+        show_grid();
+        printf("Move played: %s\n", move_str(current_move.row, current_move.col, move));
+        turn_over = TRUE;
       }
       break;
 
     case CONT:
-      if((err_encountered = cont(directive, &current_move))) {
-        print_error(err_encountered);
-        print_current_player();
-        dealloc_char(MAX_WORDS, directive);
-        process(next_directive());
-      }
-      else {
-        print_grid();
-        printf("Move played: %c%d\n", current_move.col+'A' ,current_move.row+1);
-        dealloc_char(MAX_WORDS, directive);
+      if(!(err_encountered = cont(directive, &current_move))) {
+        if(current_move.row == SWAP_MOVE)
+          journal_append(JL_SWAP, game.current_player, 0, 0, 0);
+        else
+          journal_append(JL_MOVE, game.current_player, 0, current_move.row, current_move.col);
+        show_grid();
+        printf("Move played: %s\n", (current_move.row == SWAP_MOVE) ? "swap" : move_str(current_move.row, current_move.col, move));
+        turn_over = TRUE;
       }
       break;
 
     case UNDO:
-      if((err_encountered = undo(directive)))
-        print_error(err_encountered);
-      else {
-        if(swap_occured && first_move == NULL) {
+      if(!(err_encountered = undo(directive))) {
+        if(engine->history.swapped && !engine->history.ply) {
           game.swap = ON;
           game.current_player = W;
         }
         else
           game.current_player = game.user;
 
-        print_grid();
+        journal_goto(TRUE);
+        show_grid();
       }
-
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
       break;
 
     case SUGGEST:
-      if((err_encountered = suggest(directive)))
-        print_error(err_encountered);
-
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
+      err_encountered = suggest(directive);
       break;
 
     case LEVEL:
-      if((err_encountered = level(directive)))
-        print_error(err_encountered);
-
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
+      if(!(err_encountered = level(directive)) && directive[1])
+        journal_append(JL_LEVEL, B, 0, game.level, 0);
       break;
 
     case SWAP:
-      if((err_encountered = swap(directive))) {
-        print_error(err_encountered);
-        print_current_player();
-        dealloc_char(MAX_WORDS, directive);
-        process(next_directive());
-      }
-      else {
-        swap_occured = TRUE;
-        print_grid();
+      if(!(err_encountered = swap(directive))) {
+        journal_append(JL_SWAP, game.current_player, 0, 0, 0);
+        show_grid();
         printf("Move played: swap\n");
-        dealloc_char(MAX_WORDS, directive);
+        turn_over = TRUE;
       }
       break;
 
-    case SAVE:
-      if((err_encountered = save(directive)))
-        print_error(err_encountered);
+    case GOTO:
+    case BACK:
+    case FORWARD:
+      err_encountered = (dir_ind == GOTO) ? go_to(directive) : (dir_ind == BACK) ? back(directive) : forward(directive);
+      if(!err_encountered) {
+        /* The swap rule only applies to the first move: if it was used, it's available again at ply 0 */
+        if(engine->history.swapped)
+          game.swap = engine->history.ply ? OFF : ON;
+
+        journal_goto(FALSE);
+        show_grid();
+        printf("Ply %d of %d\n", engine->history.ply, engine->history.length);
+      }
+      break;
+
+    case REPLAY:
+      if(!(err_encountered = replay(directive))) {
+        if(engine->history.swapped)
+          game.swap = engine->history.ply ? OFF : ON;
+        journal_goto(FALSE);
+      }
+      break;
 
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
+    case SAVE:
+      err_encountered = save(directive);
       break;
 
     case LOAD:
-      if((err_encountered = load(directive)))
-        print_error(err_encountered);
-      else
-        print_grid();
+      if(!(err_encountered = load(directive))) {
+        calibrate_level();
+        journal_position();
+        show_grid();
+      }
+      break;
 
-      print_current_player();
-      dealloc_char(MAX_WORDS,directive);
-      process(next_directive());
+    case ANALYZE:
+      err_encountered = analyze(directive);
+      break;
+
+    case STOP:
+      err_encountered = stop(directive);
+      break;
+
+    case CALIBRATE:
+      err_encountered = calibrate(directive);
       break;
 
     case SHOWSTATE:
       if(directive[1] != NULL)
-        print_error(INVALID_DIRECTIVE);
+        err_encountered = INVALID_DIRECTIVE;
       else
         print_grid();
-
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
       break;
 
     case QUIT:
-      if(directive[1] != NULL) {
-        print_error(INVALID_DIRECTIVE);
-        print_current_player();
-        dealloc_char(MAX_WORDS, directive);
-        process(next_directive());
-      }
+      if(directive[1] != NULL)
+        err_encountered = INVALID_DIRECTIVE;
       else {
-        if(first_game.grid != game.grid)
-          dealloc_char(first_game.dimension, first_game.grid);
-
-        delete_move_list(&first_move);
-        dealloc_char(game.dimension, game.grid);
-        dealloc_char(MAX_WORDS, directive);
+        if(engine->first_game.grid != game.grid)
+          free_grid(engine->first_game.grid);
+
+        journal_close();
+        history_free();
+        free_grid(game.grid);
+        nn_free(network);
+        pcache_close();
+        solved_close();
+        openings_close();
         exit(EXIT_SUCCESS);
       }
       break;
 
     default:
-      print_error(INVALID_DIRECTIVE);
-      print_current_player();
-      dealloc_char(MAX_WORDS, directive);
-      process(next_directive());
+      err_encountered = INVALID_DIRECTIVE;
       break;
   }
+
+  /* The same player is prompted again for another directive */
+  if(!turn_over) {
+    if(err_encountered)
+      print_error(err_encountered);
+    print_current_player();
+  }
+
+  return turn_over;
 }
 
 int newgame(char **directive) {
-  game_t temp = first_game;
+  game_t temp = engine->first_game;
 
   /* This will become W in main.c, after process(next_directive()) */
   temp.current_player = B;
 
   /* If there are no parameters, restart the game with the default settings */
   if(!directive[1]) {
-    if(game.grid != first_game.grid)
-      dealloc_char(game.dimension, game.grid);
+    if(game.grid != engine->first_game.grid)
+      free_grid(game.grid);
 
     game = temp;
     empty_grid();
@@ -201,8 +229,8 @@ int newgame(char **directive) {
 
   /* If there isn't a second parameter, restart the game with the new settings */
   if(!directive[2]) {
-    if(game.grid != first_game.grid)
-      dealloc_char(game.dimension, game.grid);
+    if(game.grid != engine->first_game.grid)
+      free_grid(game.grid);
 
     game = temp;
     empty_grid();
@@ -219,71 +247,52 @@ int newgame(char **directive) {
 
   /* If there isn't a third parameter, restart the game with the new settings */
   if(!directive[3]) {
-    if(game.grid != first_game.grid)
-      dealloc_char(game.dimension, game.grid);
+    if(game.grid != engine->first_game.grid)
+      free_grid(game.grid);
 
     game = temp;
     empty_grid();
     return NO_ERROR;
   }
 
-  /* Otherwise, the final parameter must be the grid's new dimension, in the range [4,26] */
+  /* Otherwise, the final parameter must be the grid's new dimension, in the range [MIN_DIMENSION,MAX_DIMENSION] */
   for(int i = 0; directive[3][i] != '\0'; i++)
     if(!is_digit(directive[3][i]))
       return INVALID_DIRECTIVE;
 
   temp.dimension = atoi(directive[3]);
-  if(temp.dimension < 4 || temp.dimension > 26)
+  if(temp.dimension < MIN_DIMENSION || temp.dimension > MAX_DIMENSION)
     return INVALID_DIMENSION;
   if(directive[4] != NULL)
     return INVALID_DIRECTIVE; /* newgame has received more than 3 arguments */
 
-  if(game.grid != first_game.grid)
-    dealloc_char(game.dimension, game.grid);
+  /* Finally, restart the game with the new settings, on a grid of the new size */
+  char **grid;
+  if(!(grid = alloc_grid(temp.dimension)))
+    return MEMALLOC_ERROR;
+  if(game.grid != engine->first_game.grid)
+    free_grid(game.grid);
 
-  /* Finally, restart the game with the new settings */
   game = temp;
-  init_grid();
+  set_grid(grid);
   return NO_ERROR;
 }
 
 int play(char **directive, Move *current_move) {
   /* play must receive exactly one parameter (the player's move) */
-  if(directive[2] != NULL || !directive[1] || (directive[1][2] != '\0' &&  directive[1][3] != '\0'))
+  if(directive[2] != NULL || !directive[1])
     return INVALID_DIRECTIVE;
   else if(game.current_player != game.user) /* .. and it should be used on the user's turn */
     return WRONG_PLAYER;
 
-  int strind = 0;
-  current_move->col = directive[1][strind++];
-  if(current_move->col >= 'A' && current_move->col <= 'A' + (game.dimension-1)) {
-    current_move->row = 0;
-
-    if(is_digit(directive[1][strind])) {
-      do {
-        current_move->row = current_move->row*10 + (directive[1][strind++]-'0');
-      } while((is_digit(directive[1][strind])));
-    }
-    else
-      return INVALID_MOVE;
-
-    if(current_move->row < 0 || current_move->row > game.dimension)
-      return INVALID_MOVE;
-
-    /* Translate the given move into array indeces */
-    current_move->row -= 1;
-    current_move->col -= 'A';
-
-    if(game.grid[current_move->row][current_move->col] == ' ')
-      game.grid[current_move->row][current_move->col] = (game.current_player == W) ? 'w' : 'b';
-    else
-      return OCCUPIED_POSITION;
-  }
-  else
+  /* Translate the given move into array indeces */
+  if(parse_move(directive[1], &current_move->row, &current_move->col))
     return INVALID_MOVE;
 
-  insert_at_end(&first_move, &last_move, current_move->row, current_move->col);
-  return NO_ERROR;
+  if(game.grid[current_move->row][current_move->col] != ' ')
+    return OCCUPIED_POSITION;
+
+  return play_move(current_move->row, current_move->col) ? NO_ERROR : MEMALLOC_ERROR;
 }
 
 int cont(char **directive, Move *current_move) {
@@ -292,11 +301,25 @@ int cont(char **directive, Move *current_move) {
   if(game.current_player == game.user) /* .. and it should not be used on the user's turn */
     return UNAVAILABLE_CONT;
 
-  static double total_time_elapsed = 0.0;
-  int moves_played = move_count(first_move);
+  int moves_played = engine->history.ply, score;
+
+  /* Under the swap rule, the first-move table (if one is loaded) decides whether to take over */
+  /* the user's first move, and which first move to play: the position's true value is no guide */
+  if(game.swap == ON && moves_played == 1 && opening_swap()) {
+    swap_first_move(game.current_player);
+    current_move->row = current_move->col = SWAP_MOVE;
+    return NO_ERROR;
+  }
+  if(game.swap == ON && moves_played == 0 && opening_move(current_move))
+    return play_move(current_move->row, current_move->col) ? NO_ERROR : MEMALLOC_ERROR;
+
+  /* Solved positions (on small grids, if a database is loaded) are answered straight away. On */
+  /* the difficulty ladder, the level's time covers the whole move, the solver's part included */
+  double deadline = game.level ? wall_time() + level_seconds[game.level-1] : 0;
+  bool solved = solved_probe(current_move, &score, deadline);
 
   /* The computer's opening move will be played around the center of the grid */
-  if(game.dimension >= 5 && moves_played < 2) {
+  if(!solved && game.dimension >= 5 && moves_played < 2) {
     current_move->row = game.dimension/2;
     current_move->col = current_move->row - (!(game.dimension % 2));
 
@@ -304,96 +327,217 @@ int cont(char **directive, Move *current_move) {
       current_move->row -= 1 + (game.dimension > 5 && (game.dimension & 01));
       current_move->col++;
     }
-  }  /* Plays some of the opening moves randomly, if the grid's dimension is large enough */
-  else if(game.dimension > MAX_DIM && moves_played < game.dimension) {
-    do {
-      current_move->row = rand() % game.dimension;
-      current_move->col = rand() % game.dimension;
-    } while(game.grid[current_move->row][current_move->col] != ' ');
   }
-  else { /* The "normal" case: initiates a minimax search to find the best move available */
-    max_time = optimal_time_limit(total_time_elapsed);
-    timer = clock();
-
-    /* Iterative deepening is applied on top of minimax */
-    int max_difficulty = game.difficulty;
-    for(game.difficulty = 1; game.difficulty <= max_difficulty; game.difficulty++) {
-      int eval = 0;
-      minimax(game.difficulty, TRUE, -INF, INF, current_move, &eval);
-      if(eval == INF || eval == -INF) break; /* Critical move found, stop the search */
+  else if(!solved) { /* The "normal" case: initiates a minimax search to find the best move available */
+    hex_limits limits = {0, optimal_time_limit(engine->total_time_elapsed), 1, engine->node_limit};
+    hex_result result;
+
+    /* On the difficulty ladder, the search goes as deep as the level's budget allows */
+    if(game.level) {
+      double remaining = deadline - wall_time();
+
+      limits.depth = game.dimension*game.dimension;
+      if(remaining < limits.seconds)
+        limits.seconds = (remaining > MIN_SECONDS) ? remaining : MIN_SECONDS;
+      limits.nodes = level_nodes(game.level);
+      engine->time_cap = limits.seconds;
     }
 
-    total_time_elapsed += calc_time(timer);
-    game.difficulty = max_difficulty;
+    hex_search(engine, &limits, &result);
+    engine->total_time_elapsed += calc_time(engine->timer);
+    engine->time_cap = 0;
+
+    current_move->row = result.row;
+    current_move->col = result.col;
   }
 
-  game.grid[current_move->row][current_move->col] = (game.current_player == W) ? 'w' : 'b';
-  insert_at_end(&first_move, &last_move, current_move->row, current_move->col);
-  return NO_ERROR;
+  return play_move(current_move->row, current_move->col) ? NO_ERROR : MEMALLOC_ERROR;
 }
 
 int undo(char **directive) {
   if(directive[1] != NULL) /* undo must not receive any parameters */
     return INVALID_DIRECTIVE;
 
+  history_t *h = &engine->history;
+
   /* It also cannot be used if the grid's empty, or the first player isn't the user */
-  if(!first_move)
+  if(!h->ply)
     return EMPTY_MOVE_LIST;
-  else if(first_move == last_move && first_move->player_clr != game.user)
+  else if(h->ply == 1 && h->moves[0].player_clr != game.user)
     return NO_USER_MOVE_YET;
 
-  /* If the user played last, delete his move */
-  if(last_move->player_clr == game.user) {
-    game.grid[last_move->row][last_move->col] = ' ';
-    remove_last_node(&first_move, &last_move);
-    return NO_ERROR;
+  /* If the user played last, delete his move, otherwise delete the last two moves */
+  history_goto(h->ply - ((h->moves[h->ply-1].player_clr == game.user) ? 1 : 2));
+  history_truncate();
+  return NO_ERROR;
+}
+
+int suggest(char **directive) {
+  int lines = 1;
+
+  /* suggest may receive one parameter, the number of moves to suggest */
+  if(directive[1]) {
+    if(directive[2] != NULL || (lines = parse_lines(directive[1])) < 0)
+      return INVALID_DIRECTIVE;
   }
+  if(game.current_player != game.user) /* .. and it should be used on the user's turn */
+    return UNAVAILABLE_SUGGEST;
 
-  /* Otherwise, delete the last two moves */
-  Listptr usr_move = first_move;
-  while(usr_move->next_move != last_move)
-    usr_move = usr_move->next_move;
+  hex_limits limits = {0, MOVE_TIME_LIMIT, lines, engine->node_limit};
+  hex_result results[HEX_MAX_LINES];
+  char move[MAX_MOVE_STR];
 
-  game.grid[last_move->row][last_move->col] = ' ';
-  remove_last_node(&first_move, &last_move);
+  hex_search(engine, &limits, &results[0]);
+  if(!directive[1]) {
+    printf("You may play at %s\n", results[0].move);
+    return NO_ERROR;
+  }
 
-  game.grid[usr_move->row][usr_move->col] = ' ';
-  remove_last_node(&first_move, &last_move);
+  /* The best moves, all found by one search, each with its score and the expected continuation */
+  lines = hex_search_lines(engine, results);
+  for(int k = 0; k < lines; k++) {
+    printf("%d. %s (%s):", k+1, results[k].move, score_str(results[k].score, move));
+    for(int p = 0; p < results[k].pv_length; p++)
+      printf(" %s", move_str(results[k].pv[p].row, results[k].pv[p].col, move));
+    putchar('\n');
+  }
   return NO_ERROR;
 }
 
-int suggest(char **directive) {
-  if(directive[1] != NULL) /* suggest must not receive any parameters */
+/* Prints the analysis' progress: the depth completed, its score and variation, and the speed */
+static void report_analysis(double start) {
+  hex_result result;
+  char move[MAX_MOVE_STR];
+  int depth = hex_search_progress(analysis.engine, &result);
+  long nodes = hex_search_nodes(analysis.engine);
+  double elapsed = wall_time() - start;
+
+  flockfile(stdout); /* The main thread may be printing too */
+  printf("depth %d score %s nodes %ld nps %.0f pv", depth, score_str(result.score, move), nodes,
+         (elapsed > 0) ? nodes / elapsed : 0.0);
+  for(int p = 0; p < result.pv_length; p++)
+    printf(" %s", move_str(result.pv[p].row, result.pv[p].col, move));
+  putchar('\n');
+  fflush(stdout);
+  funlockfile(stdout);
+}
+
+/* The analysis thread: searches a slice at a time, until the search is over or it's told to stop */
+static void *run_analysis(void *arg) {
+  double start = wall_time(), last_report = start;
+  hex_result result;
+  bool over;
+
+  while(TRUE) {
+    pthread_mutex_lock(&analysis.pause);
+    over = hex_search_step(analysis.engine, ANALYSIS_SLICE, &result);
+    pthread_mutex_unlock(&analysis.pause);
+
+    if(over || __atomic_load_n(&analysis.stop, __ATOMIC_RELAXED))
+      break;
+    if(wall_time() - last_report >= analysis.interval) {
+      report_analysis(start);
+      last_report = wall_time();
+    }
+  }
+
+  if(!over)
+    hex_search_stop(analysis.engine, &result);
+
+  report_analysis(start);
+  printf("Analysis %s, best move: %s\n", over ? "finished" : "stopped", result.move);
+  fflush(stdout);
+  return arg;
+}
+
+int analyze(char **directive) {
+  double interval = 1.0;
+  char *end;
+  int error;
+
+  /* analyze may receive one parameter, the number of seconds between reports */
+  if(directive[1] && (directive[2] || (interval = strtod(directive[1], &end)) <= 0 || *end != '\0'))
     return INVALID_DIRECTIVE;
-  if(game.current_player != game.user) /* .. and it should be used on the user's turn */
-    return UNAVAILABLE_SUGGEST;
 
-  Move current_move;
+  /* The search is open-ended: it goes as deep as the grid allows, until it's stopped */
+  hex_limits limits = {game.dimension*game.dimension, 1e9};
 
-  max_time = MOVE_TIME_LIMIT;
-  timer = clock();
+  if(!(analysis.engine = hex_clone(engine)))
+    return MEMALLOC_ERROR;
+  analysis.interval = interval;
+  analysis.stop = FALSE;
+  error = hex_search_start(analysis.engine, &limits);
 
-  /* Iterative deepening is applied on top of minimax */
-  int max_difficulty = game.difficulty;
-  for(game.difficulty = 1; game.difficulty <= max_difficulty; game.difficulty++) {
-    int eval = 0;
-    minimax(game.difficulty, TRUE, -INF, INF, &current_move, &eval);
-    if(eval == INF || eval == -INF) break; /* Critical move found, stop the search */
+  if(!error && pthread_create(&analysis.thread, NULL, run_analysis, NULL))
+    error = MEMALLOC_ERROR;
+  if(error) {
+    hex_destroy(analysis.engine);
+    return error;
   }
 
-  game.difficulty = max_difficulty;
+  analysis.running = TRUE;
+  return NO_ERROR;
+}
+
+int stop(char **directive) {
+  if(directive[1] != NULL) /* stop must not receive any parameters */
+    return INVALID_DIRECTIVE;
+  if(!analysis.running) /* .. and there must be an analysis to stop */
+    return UNAVAILABLE_STOP;
 
-  printf("You may play at %c%d\n", current_move.col+'A', current_move.row+1);
+  stop_analysis();
   return NO_ERROR;
 }
 
+void stop_analysis(void) {
+  if(!analysis.running)
+    return;
+
+  __atomic_store_n(&analysis.stop, TRUE, __ATOMIC_RELAXED);
+  pthread_join(analysis.thread, NULL);
+  hex_destroy(analysis.engine);
+  analysis.running = FALSE;
+}
+
+/* Parses suggest's number of moves (1 to HEX_MAX_LINES), returning -1 if it's invalid */
+int parse_lines(const char *word) {
+  for(int i = 0; word[i] != '\0'; i++)
+    if(!is_digit(word[i]) || i > 1)
+      return -1;
+
+  int lines = atoi(word);
+  return (lines >= 1 && lines <= HEX_MAX_LINES) ? lines : -1;
+}
+
+/* Writes a search score in <str>: a number, or "win"/"loss" for forced results */
+char *score_str(int score, char *str) {
+  if(score == INF)
+    strcpy(str, "win");
+  else if(score == -INF)
+    strcpy(str, "loss");
+  else
+    sprintf(str, "%d", score);
+  return str;
+}
+
+/* Prints a level's time limit, and its node budget once the grid's size has been calibrated */
+static void print_level(int level) {
+  printf("Level %d: at most %gs per move", level, level_seconds[level-1]);
+  if(search_speed[game.dimension] > 0)
+    printf(", %ld nodes", level_nodes(level));
+  printf("\n");
+}
+
 int level(char **directive) {
-  if(!directive[1]) { /* If there are no parameters, just print the current difficulty */
-    printf("Current game difficulty: %d\n", game.difficulty);
+  if(!directive[1]) { /* If there are no parameters, just print the current level */
+    if(game.level)
+      print_level(game.level);
+    else
+      printf("Current game difficulty: %d plies (no level set)\n", game.difficulty);
     return NO_ERROR;
   }
 
-  /* Otherwise, level must only take one parameter, which is the new game's difficulty */
+  /* Otherwise, level must only take one parameter, which is the new level */
   if(directive[2] != NULL)
     return INVALID_DIRECTIVE;
 
@@ -401,12 +545,84 @@ int level(char **directive) {
     if(!is_digit(directive[1][i]))
       return INVALID_DIRECTIVE;
 
-  /* The game difficulty cannot exceed the maximum game-tree depth: game.dimension^2 */
-  game.difficulty = atoi(directive[1]);
-  if(game.difficulty > game.dimension*game.dimension)
+  int new_level = atoi(directive[1]);
+  if(new_level < 1 || new_level > LEVELS)
     return INVALID_DIFFICULTY;
 
-  printf("New game difficulty: %d\n", game.difficulty);
+  game.level = new_level;
+  calibrate_level();
+  print_level(game.level);
+  return NO_ERROR;
+}
+
+/* Measures this machine's search speed on the game's grid size. The reference positions hold */
+/* <dimension> stones each, spread by a fixed sequence so that they're the same on any machine, */
+/* and each is searched for CALIBRATION_SECONDS (positions answered without a search, by the */
+/* solver or the persistent cache, don't count) */
+static double measure_speed(void) {
+  int n = game.dimension;
+  long nodes = 0;
+  double seconds = 0;
+
+  for(int p = 0; p < CALIBRATION_POSITIONS; p++) {
+    hex_engine *e = hex_create(n);
+    uint32_t state = p+1;
+    char move[MAX_MOVE_STR];
+    hex_result result;
+
+    if(!e) /* The speed is then unknown, unless earlier positions measured it */
+      break;
+
+    for(int k = 0; k < n; k++) {
+      int cell;
+
+      do {
+        state = state*1664525 + 1013904223;
+        cell = (state >> 8) % (n*n);
+      } while(hex_play(e, move_str(cell / n, cell % n, move)) != NO_ERROR);
+    }
+
+    double start = wall_time();
+    if(!hex_search(e, &(hex_limits) {n*n, CALIBRATION_SECONDS, 1, 0}, &result)) {
+      seconds += wall_time() - start;
+      nodes += hex_search_nodes(e);
+    }
+    hex_destroy(e);
+  }
+
+  return (nodes && seconds > 0) ? nodes / seconds : -1;
+}
+
+/* Measures the grid's size when a level is set and it hasn't been measured yet: this happens */
+/* when the level or the grid's size is set, so the measuring never counts towards a move's time. */
+/* A running analysis (which level leaves running) is paused meanwhile, so as not to slow it down */
+void calibrate_level(void) {
+  if(game.level && !search_speed[game.dimension]) {
+    pthread_mutex_lock(&analysis.pause);
+    search_speed[game.dimension] = measure_speed();
+    pthread_mutex_unlock(&analysis.pause);
+  }
+}
+
+/* A level's node budget: what this machine searches in LEVEL_SHARE of the level's time. If the */
+/* grid's speed is unknown (not measured, or it couldn't be), there's no node budget (0), and */
+/* the level's time limit alone holds */
+long level_nodes(int level) {
+  if(search_speed[game.dimension] <= 0)
+    return 0;
+  return (long) (search_speed[game.dimension] * LEVEL_SHARE * level_seconds[level-1]);
+}
+
+int calibrate(char **directive) {
+  if(directive[1] != NULL) /* calibrate must not receive any parameters */
+    return INVALID_DIRECTIVE;
+
+  if((search_speed[game.dimension] = measure_speed()) < 0)
+    printf("Search speed on %dx%d grids: unknown (the reference positions needed no search)\n", game.dimension, game.dimension);
+  else
+    printf("Search speed on %dx%d grids: %.0f nodes/s\n", game.dimension, game.dimension, search_speed[game.dimension]);
+  for(int level = 1; level <= LEVELS; level++)
+    print_level(level);
   return NO_ERROR;
 }
 
@@ -415,16 +631,8 @@ int swap(char **directive) {
     return INVALID_DIRECTIVE;
 
   /* .. and it should be used on the user's turn, if available */
-  if(game.swap == ON && first_move == last_move && first_move->player_clr != game.user) {
-    /* Play the symmetric move for user */
-    game.grid[first_move->row][first_move->col] = ' ';
-    game.grid[first_move->col][first_move->row] = (game.user == W) ? 'w' : 'b';
-
-    /* swap first_move's row and col values and update first_move's player_clr */
-    XORSWAP(first_move->row, first_move->col);
-    first_move->player_clr = game.user;
-
-    game.swap = OFF;
+  if(game.swap == ON && engine->history.ply == 1 && engine->history.moves[0].player_clr != game.user) {
+    swap_first_move(game.user);
     return NO_ERROR;
   }
 
@@ -435,16 +643,21 @@ int save(char **directive) {
   if(!directive[1] || directive[2] != NULL) /* save must receive exactly one parameter */
     return INVALID_DIRECTIVE;
 
+  char cells[MAX_CELLS];
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++)
+      cells[i*game.dimension + j] = (game.grid[i][j] == ' ') ? 'n' : game.grid[i][j];
+
   FILE *statefile;
   if(!(statefile = fopen(directive[1], "wb")))
     return STATEFILE_ERROR;
 
-  putc(game.dimension, statefile);
+  /* The dimension is stored in a widened, big-endian 2-byte header, marked by STATEFILE_MAGIC */
+  putc(STATEFILE_MAGIC, statefile);
+  putc(game.dimension >> 8, statefile);
+  putc(game.dimension & 0xFF, statefile);
   putc((game.current_player) ? 'w' : 'b', statefile);
-
-  for(int i = 0; i < game.dimension; i++)
-    for(int j = 0; j < game.dimension; j++)
-      putc((game.grid[i][j] == ' ') ? 'n' : game.grid[i][j], statefile);
+  fwrite(cells, 1, game.dimension*game.dimension, statefile);
 
   fclose(statefile);
   return NO_ERROR;
@@ -454,101 +667,151 @@ int load(char **directive) {
   if(!directive[1] || directive[2]) /* load must receive exactly one parameter */
     return INVALID_DIRECTIVE;
 
-  char token;
-  game_t temp = game; /* Save current game settings, in case of error */
+  int dimension, token;
+  char cells[MAX_CELLS+1];
+  size_t count;
 
   FILE *statefile;
   if(!(statefile = fopen(directive[1], "rb")))
     return STATEFILE_ERROR;
 
-  game.dimension = getc(statefile);
-  if(game.dimension < 4 || game.dimension > 26) {
-    game = temp;
-    fclose(statefile);
-    return INVALID_DIMENSION;
+  /* Statefiles written before the header was widened store the dimension in a single byte */
+  if((dimension = getc(statefile)) == STATEFILE_MAGIC) {
+    dimension = getc(statefile) << 8;
+    dimension |= getc(statefile);
   }
 
-  init_grid(); /* game.grid now points to a new address (temp still points to the last one) */
-  if((token = getc(statefile)) == 'b')
-    game.current_player = B;
-  else if(token == 'w')
-    game.current_player = W;
-  else {
+  if(dimension < MIN_DIMENSION || dimension > MAX_DIMENSION) {
     fclose(statefile);
-    dealloc_char(game.dimension, game.grid);
-    game = temp;
-    return STATEFILE_ERROR;
+    return INVALID_DIMENSION;
   }
 
-  for(int i = 0; i < game.dimension; i++)
-    for(int j = 0; j < game.dimension; j++) {
-      token = getc(statefile);
-      if(token == 'b' || token == 'w')
-        game.grid[i][j] = token;
-      else if(token == 'n')
-        game.grid[i][j] = ' ';
-      else {
-        fclose(statefile);
-        dealloc_char(game.dimension, game.grid);
-        game = temp;
-        return STATEFILE_ERROR;
-      }
-    }
+  /* The player to move, then the cells in one block (asking for one more byte catches trailing ones) */
+  token = getc(statefile);
+  count = fread(cells, 1, dimension*dimension + 1, statefile);
+  fclose(statefile);
 
-  if((token = getc(statefile)) != EOF) {
-    fclose(statefile);
-    dealloc_char(game.dimension, game.grid);
-    game = temp;
+  cells[count] = '\0';
+  if((token != 'b' && token != 'w') || count != (size_t) dimension*dimension || strspn(cells, "bwn") != count)
     return STATEFILE_ERROR;
-  }
 
-  if(temp.grid != first_game.grid)
-    dealloc_char(temp.dimension, temp.grid);
+  /* The statefile is valid, so the game is only changed now (keeping its grid, if it's the same size) */
+  if(!resize_grid(dimension))
+    return MEMALLOC_ERROR;
 
-  delete_move_list(&first_move);
-  first_move = last_move = NULL;
-  fclose(statefile);
+  game.current_player = (token == 'w') ? W : B;
+  for(int c = 0; c < dimension*dimension; c++)
+    if(cells[c] != 'n')
+      set_hex(c / dimension, c % dimension, cells[c]);
+
+  history_clear();
   return NO_ERROR;
 }
 
-/* Parses a line into words, stores them in a string vector and then returns that vector */
-char **next_directive(void) {
-  char **directive;
-  int w_count, ch_count, token;
+/* Parses a number of plies, returning -1 if it's invalid */
+static int parse_plies(const char *word) {
+  for(int i = 0; word[i] != '\0'; i++)
+    if(!is_digit(word[i]) || i > 5)
+      return -1;
 
-  /* Allocate memory for the directive */
-  if(!(directive = malloc(sizeof(char *) * MAX_WORDS))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-  for(w_count = 0; w_count < MAX_WORDS; w_count++)
-    if(!(directive[w_count] = malloc(sizeof(char) * MAX_WORD_SIZE))) {
-      print_error(MEMALLOC_ERROR);
-      exit(EXIT_FAILURE);
-    }
+  return atoi(word);
+}
 
-  printf("> ");
+int go_to(char **directive) {
+  int ply;
 
-  w_count = 0;
-  skip_whitespace();
+  /* goto must receive exactly one parameter, a ply between 0 and the history's length */
+  if(!directive[1] || directive[2] || (ply = parse_plies(directive[1])) < 0)
+    return INVALID_DIRECTIVE;
+  if(ply > engine->history.length)
+    return INVALID_PLY;
 
-  while((token = getchar()) != '\n' && w_count < MAX_WORDS - 1) {
-    ch_count = 0;
+  history_goto(ply);
+  return NO_ERROR;
+}
 
-    /* Reads next word */
-    do {
-      directive[w_count][ch_count++] = token;
-    } while(!is_whitespace(token = getchar()) && ch_count < MAX_WORD_SIZE - 1 && token != '\n');
+int back(char **directive) {
+  int plies = 1;
 
-    directive[w_count++][ch_count] = '\0';
+  /* back may receive one parameter, the number of plies */
+  if(directive[1] && (directive[2] || (plies = parse_plies(directive[1])) < 0))
+    return INVALID_DIRECTIVE;
+  if(plies > engine->history.ply)
+    return INVALID_PLY;
 
-    if(token == '\n')
-      break;
-    skip_whitespace();
+  history_goto(engine->history.ply - plies);
+  return NO_ERROR;
+}
+
+int forward(char **directive) {
+  int plies = 1;
+
+  /* forward may receive one parameter, the number of plies */
+  if(directive[1] && (directive[2] || (plies = parse_plies(directive[1])) < 0))
+    return INVALID_DIRECTIVE;
+  if(plies > engine->history.length - engine->history.ply)
+    return INVALID_PLY;
+
+  history_goto(engine->history.ply + plies);
+  return NO_ERROR;
+}
+
+/* Shows the history's positions from the start of the game to its last move, <seconds> apart */
+/* (REPLAY_SECONDS by default), ending there */
+int replay(char **directive) {
+  history_t *h = &engine->history;
+  double seconds = REPLAY_SECONDS;
+  char move[MAX_MOVE_STR], *end;
+
+  /* replay may receive one parameter, the pause between two moves */
+  if(directive[1] && (directive[2] || (seconds = strtod(directive[1], &end)) < 0 || *end != '\0'))
+    return INVALID_DIRECTIVE;
+
+  history_goto(0);
+  show_grid();
+  for(int p = 0; p < h->length; p++) {
+    struct timespec pause = {(time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9)};
+
+    if(!engine->quiet)
+      fflush(stdout);
+    nanosleep(&pause, NULL);
+
+    history_goto(p+1);
+    show_grid();
+    printf("%d. %s\n", p+1, move_str(h->moves[p].row, h->moves[p].col, move));
   }
+  return NO_ERROR;
+}
+
+/* Reads a line and splits it into words, returned in a NULL-terminated vector. Nothing is */
+/* allocated: the vector and the words live in static buffers, reused by the next call. A line */
+/* with more than MAX_WORDS-1 words, or a word over MAX_WORD_SIZE-1 characters, reads as an */
+/* invalid directive, and the end of the input as "quit" */
+char **next_directive(void) {
+  static char line[MAX_LINE], invalid[] = "";
+  static char *directive[MAX_WORDS];
+  int w_count = 0;
+  char *save_ptr;
+
+  if(!engine->quiet)
+    printf("> ");
 
-  if(token != '\n')
+  if(!fgets(line, sizeof(line), stdin))
+    strcpy(line, "quit");
+  else if(!strchr(line, '\n') && !feof(stdin)) { /* The line doesn't fit */
     input_flush();
+    line[0] = '\0';
+    directive[w_count++] = invalid;
+  }
+
+  for(char *word = strtok_r(line, " \t\r\n", &save_ptr); word; word = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+    if(w_count == MAX_WORDS-1 || strlen(word) >= MAX_WORD_SIZE) {
+      directive[0] = invalid;
+      w_count = 1;
+      break;
+    }
+    directive[w_count++] = word;
+  }
 
   directive[w_count] = NULL;
   return directive;
@@ -571,7 +834,14 @@ int get_index(char **directive) {
     "save",
     "load",
     "showstate",
-    "quit"
+    "quit",
+    "analyze",
+    "stop",
+    "calibrate",
+    "goto",
+    "back",
+    "forward",
+    "replay"
   };
 
   int directive_count = sizeof(directives) / sizeof(directives[0]);
@@ -1,12 +1,21 @@
 #define XORSWAP(a,b) ((a)^=(b),(b)^=(a),(a)^=(b)) /* Alternative way of swapping two variable's values */
 
-typedef struct move_list Move;
+typedef struct move Move;
 
 #define MAX_DIRECTIVE 10
 #define MAX_WORDS      6
 #define MAX_WORD_SIZE 32
+#define MAX_LINE     256 /* Longest directive line */
 
-#define MAX_DIM 10  /* If the grid's dimension is bigger than this value, cont will initially play randomly */
+#define STATEFILE_MAGIC 0xFF /* Can't be a legacy (single byte, at most 26) dimension */
+
+#define MAX_DIM 10  /* If the grid's dimension is bigger than this value, searches are selective (see hex.h) */
+
+#define CALIBRATION_POSITIONS 4 /* Reference positions calibrate() searches .. */
+#define CALIBRATION_SECONDS 0.25 /* .. for this long each */
+#define MIN_SECONDS 0.001 /* The time left to a level's search if the solver used up the level's time */
+#define SWAP_MOVE -1 /* The row and column of cont's move when the computer swaps */
+#define REPLAY_SECONDS 1.0 /* replay's default pause between two moves */
 
 /* Directive indeces */
 #define NEWGAME     0
@@ -20,10 +29,17 @@ typedef struct move_list Move;
 #define LOAD        8
 #define SHOWSTATE   9
 #define QUIT       10
+#define ANALYZE    11
+#define STOP       12
+#define CALIBRATE  13
+#define GOTO       14
+#define BACK       15
+#define FORWARD    16
+#define REPLAY     17
 
-char **next_directive(void); /* Parses a line into words and stores them in a string vector */
+char **next_directive(void); /* Reads a line and splits it into words (in static buffers) */
 int get_index(char **); /* Returns the index corresponding to a given directive */
-void process(char **); /* Processes a directive */
+bool process(char **); /* Processes a directive, returning TRUE if it ended the turn */
 
 /* The following functions return either NO_ERROR or an error index */
 int newgame(char **); /* Starts a new game with default settings, if no parameters are given */
@@ -31,10 +47,22 @@ int play(char **, Move *); /* Reads the next user's move and updates the hex gri
 int cont(char **, Move *); /* Computes and plays the best move for the player-computer */
 int undo(char **); /* Deletes the user's last move (and the computer's, if needed) */
 int suggest(char **); /* Suggests the optimal move for the player-user */
-int level(char **); /* Updates or prints the game's difficulty */
+int level(char **); /* Updates or prints the game's level on the difficulty ladder */
+int calibrate(char **); /* Measures the search speed the difficulty ladder's node budgets come from */
+void calibrate_level(void); /* Measures the search speed on the game's grid size, if a level needs it */
+long level_nodes(int); /* A level's node budget on the game's grid size */
+int analyze(char **); /* Starts analysing the position in the background */
+int stop(char **); /* Stops the analysis */
+void stop_analysis(void); /* Stops the analysis, if one is running */
+int parse_lines(const char *); /* Parses suggest's number of moves */
+char *score_str(int, char *); /* Writes a search score ("win"/"loss" for forced results) */
 int swap(char **); /* Applies the swap rule (if that's possible) */
 int save(char **); /* Saves the current game state in a file */
 int load(char **); /* Loads a game state from a file */
+int go_to(char **); /* Jumps to a ply of the game's history */
+int back(char **); /* Goes back a number of plies (1 by default) */
+int forward(char **); /* Goes forward a number of plies (1 by default), replaying the history's moves */
+int replay(char **); /* Replays the game's history from its start, a move at a time */
 
 #define NO_ERROR 0
 
@@ -52,3 +80,9 @@ int load(char **); /* Loads a game state from a file */
 #define UNAVAILABLE_SUGGEST 11
 #define UNAVAILABLE_CONT    12
 #define INVALID_DIFFICULTY  13
+#define WEIGHTS_ERROR       14
+#define GAME_OVER           15
+#define SEARCH_IN_PROGRESS  16
+#define UNAVAILABLE_STOP    17
+#define INVALID_PLY         18
+#define JOURNAL_ERROR       19
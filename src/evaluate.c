@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "directives.h"
+#include "evaluate.h"
+#include "templates.h"
+
+const char *feature_names[FEATURE_COUNT] = {"distance", "max_group", "centre", "coverage", "templates"};
+
+/* The default weights reproduce the original shortest-path evaluation */
+double eval_weights[FEATURE_COUNT] = {1.0, 0.0, 0.0, 0.0, 0.0};
+
+/* When a player is cut off from one of their sides, their distance is infinite. The */
+/* difference is then clamped, so that such positions don't swamp the others */
+static double distance_feature(int distance) {
+  int n = game.dimension;
+  return (distance > 2*n*n) ? 2*n*n : (distance < -2*n*n) ? -2*n*n : distance;
+}
+
+/* Computes the features other than the distance (see compute_features()) */
+static void stone_features(double *features, bool weighted_only) {
+  int n = game.dimension;
+
+  if(!weighted_only || eval_weights[F_MAX_GROUP] != 0.0)
+    features[F_MAX_GROUP] = max_seq_length_difference(W);
+
+  if(!weighted_only || eval_weights[F_CENTRE] != 0.0 || eval_weights[F_COVERAGE] != 0.0) {
+    bool white_rows[MAX_DIMENSION] = {FALSE}, black_cols[MAX_DIMENSION] = {FALSE};
+    double centre = 0.0;
+
+    for(int i = 0; i < n; i++)
+      for(int j = 0; j < n; j++) {
+        if(game.grid[i][j] == ' ')
+          continue;
+
+        /* Closeness is n-1 at the centre and decreases towards the edges */
+        double closeness = (n-1) - (abs(2*i - (n-1)) + abs(2*j - (n-1))) / 2.0;
+        if(game.grid[i][j] == 'w') {
+          centre += closeness;
+          white_rows[i] = TRUE;
+        }
+        else {
+          centre -= closeness;
+          black_cols[j] = TRUE;
+        }
+      }
+
+    features[F_CENTRE] = centre;
+    for(int k = 0; k < n; k++)
+      features[F_COVERAGE] += (int) white_rows[k] - (int) black_cols[k];
+  }
+
+  if(!weighted_only || eval_weights[F_TEMPLATES] != 0.0) {
+    stone_lines lines;
+
+    get_stone_lines(&lines);
+    features[F_TEMPLATES] = virtual_reach(&lines, W, NULL) - virtual_reach(&lines, B, NULL);
+  }
+}
+
+/* Computes the features of the current grid. If <weighted_only> is set, features */
+/* with a zero weight aren't computed (and are set to 0) */
+void compute_features(double *features, bool weighted_only) {
+  for(int f = 0; f < FEATURE_COUNT; f++)
+    features[f] = 0.0;
+
+  if(!weighted_only || eval_weights[F_DISTANCE] != 0.0)
+    features[F_DISTANCE] = distance_feature(hexes_needed_to_win_difference(W));
+
+  stone_features(features, weighted_only);
+}
+
+void count_stones(stone_count *count) {
+  int n = game.dimension;
+  bool white_rows[MAX_DIMENSION] = {FALSE}, black_cols[MAX_DIMENSION] = {FALSE};
+  int column_empty[MAX_DIMENSION] = {0}, row_empty[MAX_DIMENSION] = {0};
+
+  *count = (stone_count) {{0, 0}, {0, 0}, {INF, INF}};
+  for(int i = 0; i < n; i++)
+    for(int j = 0; j < n; j++)
+      if(game.grid[i][j] == 'w') {
+        count->stones[W]++;
+        count->lines[W] += !white_rows[i];
+        white_rows[i] = TRUE;
+      }
+      else if(game.grid[i][j] == 'b') {
+        count->stones[B]++;
+        count->lines[B] += !black_cols[j];
+        black_cols[j] = TRUE;
+      }
+      else {
+        column_empty[j]++;
+        row_empty[i]++;
+      }
+
+  /* A column is open to White if Black occupies none of its hexes (and likewise for Black's rows) */
+  for(int k = 0; k < n; k++) {
+    if(!black_cols[k])
+      count->open[W] = min(count->open[W], column_empty[k]);
+    if(!white_rows[k])
+      count->open[B] = min(count->open[B], row_empty[k]);
+  }
+}
+
+/* The range of the features that stone_features() computes, given the stones on the grid: */
+/* groups hold at most every stone of their colour, and closeness to the centre is at most n-1 */
+static void feature_bounds(const stone_count *count, double bound[FEATURE_COUNT][2]) {
+  int n = game.dimension;
+
+  bound[F_MAX_GROUP][0] = -count->stones[B];
+  bound[F_MAX_GROUP][1] = count->stones[W];
+  bound[F_CENTRE][0] = -(n-1) * count->stones[B];
+  bound[F_CENTRE][1] = (n-1) * count->stones[W];
+  bound[F_TEMPLATES][0] = -2*n;
+  bound[F_TEMPLATES][1] = 2*n;
+}
+
+/* The range of distance_feature(hexes_needed_to_win_difference(W)), without the sweeps: every */
+/* path the sweep finds crosses each of the player's lines, so it costs at least one hex per line */
+/* the player doesn't occupy, and the straight line down an open column (or along an open row) */
+/* is one of the paths it relaxes, so the cost is at most that line's empty hexes */
+static void distance_bounds(const stone_count *count, double bound[2]) {
+  int n = game.dimension;
+
+  bound[0] = distance_feature((n - count->lines[B]) - count->open[W]);
+  bound[1] = distance_feature(count->open[B] - (n - count->lines[W]));
+}
+
+void weighted_evaluate(const stone_count *count, int alpha, int beta, int *lower, int *upper) {
+  double features[FEATURE_COUNT], bound[FEATURE_COUNT][2], sum = 0.0, low = 0.0, high = 0.0;
+
+  /* The cheap stage: the coverage (which the stone count gives), and bounds on the others */
+  sum += eval_weights[F_COVERAGE] * (count->lines[W] - count->lines[B]);
+
+  feature_bounds(count, bound);
+  distance_bounds(count, bound[F_DISTANCE]);
+  for(int f = 0; f < FEATURE_COUNT; f++)
+    if(f != F_COVERAGE) {
+      low += eval_weights[f] * bound[f][eval_weights[f] < 0.0];
+      high += eval_weights[f] * bound[f][eval_weights[f] >= 0.0];
+    }
+
+  *lower = (int) lround((sum + low) * EVAL_SCALE);
+  *upper = (int) lround((sum + high) * EVAL_SCALE);
+  if(*lower == *upper || *upper <= alpha || *lower >= beta)
+    return;
+
+  /* The distance's sweeps, after which the other features can only move the sum within [low, high] */
+  if(eval_weights[F_DISTANCE] != 0.0) {
+    double distance = eval_weights[F_DISTANCE] * distance_feature(hexes_needed_to_win_difference(W));
+
+    sum += distance;
+    low -= eval_weights[F_DISTANCE] * bound[F_DISTANCE][eval_weights[F_DISTANCE] < 0.0];
+    high -= eval_weights[F_DISTANCE] * bound[F_DISTANCE][eval_weights[F_DISTANCE] >= 0.0];
+
+    *lower = (int) lround((sum + low) * EVAL_SCALE);
+    *upper = (int) lround((sum + high) * EVAL_SCALE);
+    if(*lower == *upper || *upper <= alpha || *lower >= beta)
+      return;
+  }
+
+  /* The expensive stage */
+  for(int f = 0; f < FEATURE_COUNT; f++)
+    features[f] = 0.0;
+  stone_features(features, TRUE);
+  for(int f = 0; f < FEATURE_COUNT; f++)
+    if(f != F_DISTANCE && f != F_COVERAGE)
+      sum += eval_weights[f] * features[f];
+
+  *lower = *upper = (int) lround(sum * EVAL_SCALE);
+}
+
+/* A batch's distances are evaluated one position per lane of a vector (an AVX2 register, or two */
+/* SSE2 ones): the cells' costs are stored lane by lane, and the sweeps of */
+/* hexes_needed_to_win_difference() run on every lane at once */
+typedef int16_t lanes_t __attribute__((vector_size(2*DISTANCE_LANES)));
+
+#define LANES_INF 0x3FFF /* More than any distance, and the sum of two still fits in 16 bits */
+
+/* The kernel is compiled for AVX2 and for the baseline, and the CPU picks one when the program starts */
+#if defined(__x86_64__)
+#define SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD_CLONES
+#endif
+
+static _Thread_local lanes_t lane_cost[MAX_BORDERED_CELLS], lane_step[MAX_BORDERED_CELLS];
+
+/* lane_cost[next] = min(lane_cost[next], lane_cost[c] + lane_step[next]), the sum saturating at LANES_INF */
+#define RELAX(next) do { \
+    lanes_t via = lane_cost[c] + lane_step[next], mask = via < inf; \
+    via = (via & mask) | (inf & ~mask); \
+    mask = via < lane_cost[next]; \
+    lane_cost[next] = (via & mask) | (lane_cost[next] & ~mask); \
+  } while(0)
+
+SIMD_CLONES
+static void distance_lanes(int count, char ***grids, int n, int *values) {
+  const int *offset = neighbour[n];
+  const lanes_t inf = (lanes_t) {0} + LANES_INF;
+  int needed[2][DISTANCE_LANES];
+
+  for(Colour player = B; player <= W; player++) {
+    char unreachable_hex = (player == W) ? 'b' : 'w';
+
+    /* The lanes past <count> repeat the first grid. The border's steps are never read */
+    for(int i = -1; i <= n; i++)
+      for(int j = -1; j <= n; j++) {
+        int c = (i+1)*STRIDE(n) + j+1;
+
+        lane_cost[c] = inf;
+        for(int k = 0; k < DISTANCE_LANES; k++) {
+          char hex = grids[(k < count) ? k : 0][i][j];
+          lane_step[c][k] = (hex == unreachable_hex) ? LANES_INF : (hex == ' ');
+        }
+      }
+
+    for(int k = 0; k < n; k++) {
+      int c = (player == W) ? STRIDE(n) + k+1 : (k+1)*STRIDE(n) + 1;
+      lane_cost[c] = lane_step[c];
+    }
+
+    /* The same sweeps as hexes_needed_to_win_difference(), except that the opponent's stones */
+    /* are relaxed from too (their cost stays infinite, so they change nothing) */
+    if(player == W) {
+      for(int i = 0; i < n; i++)
+        for(int j = 0; j < n; j++) {
+          int c = (i+1)*STRIDE(n) + j+1;
+
+          RELAX(c + offset[RIGHT]);
+          RELAX(c + offset[LEFT]);
+          RELAX(c + offset[DOWN_LEFT]);
+          RELAX(c + offset[DOWN]);
+        }
+    }
+    else {
+      for(int j = 0; j < n; j++)
+        for(int i = 0; i < n; i++) {
+          int c = (i+1)*STRIDE(n) + j+1;
+
+          RELAX(c + offset[UP]);
+          RELAX(c + offset[DOWN]);
+          RELAX(c + offset[RIGHT]);
+          RELAX(c + offset[UP_RIGHT]);
+        }
+    }
+
+    /* The best cost on the far side (the last row for W, the last column for B) */
+    lanes_t best = inf;
+    for(int k = 0; k < n; k++) {
+      int c = (player == W) ? n*STRIDE(n) + k+1 : (k+1)*STRIDE(n) + n;
+      lanes_t mask = lane_cost[c] < best;
+      best = (lane_cost[c] & mask) | (best & ~mask);
+    }
+
+    for(int k = 0; k < DISTANCE_LANES; k++)
+      needed[player][k] = (best[k] >= LANES_INF) ? INF : best[k];
+  }
+
+  for(int k = 0; k < count; k++)
+    values[k] = needed[B][k] - needed[W][k];
+}
+
+/* Evaluates hexes_needed_to_win_difference(W) for each of <count> grids of the given size */
+/* (allocated by alloc_grid(), so that their border can be read), storing the results in <values> */
+void distance_batch(int count, char ***grids, int dimension, int *values) {
+  for(int k = 0; k < count; k += DISTANCE_LANES)
+    distance_lanes(min(count - k, DISTANCE_LANES), grids + k, dimension, values + k);
+}
+
+/* Computes every feature of <count> grids of the current size (allocated by alloc_grid()), into */
+/* <count> rows of FEATURE_COUNT. Their distances are evaluated DISTANCE_LANES at a time */
+void compute_features_batch(int count, char ***grids, double *features) {
+  char **grid = game.grid, *cells = game.cells;
+  int distance[DISTANCE_LANES];
+
+  for(int k = 0; k < count; k++) {
+    double *row = features + k*FEATURE_COUNT;
+
+    if(k % DISTANCE_LANES == 0)
+      distance_batch(min(count - k, DISTANCE_LANES), grids + k, game.dimension, distance);
+
+    for(int f = 0; f < FEATURE_COUNT; f++)
+      row[f] = 0.0;
+    row[F_DISTANCE] = distance_feature(distance[k % DISTANCE_LANES]);
+
+    /* The other features are computed on the grid as if it were the game's */
+    game.grid = grids[k];
+    game.cells = &grids[k][-1][-1];
+    stone_features(row, FALSE);
+  }
+
+  game.grid = grid;
+  game.cells = cells;
+}
+
+/* Loads a weights file into <weights>, returning NO_ERROR or an error index. */
+/* Features that the file doesn't mention get a zero weight */
+int load_weights(char *filename, double *weights) {
+  double loaded[FEATURE_COUNT] = {0.0};
+  char line[128], name[64];
+  double value;
+
+  FILE *file;
+  if(!(file = fopen(filename, "r")))
+    return STATEFILE_ERROR;
+
+  while(fgets(line, sizeof(line), file)) {
+    if(line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+      continue;
+
+    int f = FEATURE_COUNT;
+    if(sscanf(line, "%63s %lf", name, &value) == 2)
+      for(f = 0; f < FEATURE_COUNT && strcmp(name, feature_names[f]); f++);
+
+    if(f == FEATURE_COUNT) { /* Malformed line or unknown feature */
+      fclose(file);
+      return WEIGHTS_ERROR;
+    }
+    loaded[f] = value;
+  }
+
+  fclose(file);
+  memcpy(weights, loaded, sizeof(loaded));
+  return NO_ERROR;
+}
+
+int save_weights(char *filename, double *weights) {
+  FILE *file;
+  if(!(file = fopen(filename, "w")))
+    return STATEFILE_ERROR;
+
+  fprintf(file, "# hex evaluator weights (evaluation = %d * sum of weight * feature)\n", EVAL_SCALE);
+  for(int f = 0; f < FEATURE_COUNT; f++)
+    fprintf(file, "%s %.9g\n", feature_names[f], weights[f]);
+
+  fclose(file);
+  return NO_ERROR;
+}
@@ -0,0 +1,34 @@
+#define FEATURE_COUNT 5
+#define EVAL_SCALE 100 /* Evaluation units per unit of (weighted) feature sum */
+#define DISTANCE_LANES 16 /* Positions whose distances distance_batch() evaluates at once */
+
+/* Features, all measured from White's point of view */
+#define F_DISTANCE  0 /* hexes_needed_to_win_difference() */
+#define F_MAX_GROUP 1 /* max_seq_length_difference() */
+#define F_CENTRE    2 /* Difference of the stones' closeness to the centre */
+#define F_COVERAGE  3 /* Rows spanned by White's stones minus columns spanned by Black's */
+#define F_TEMPLATES 4 /* Difference of virtual_reach() (templates.h): lines virtually joined to the edges */
+
+extern const char *feature_names[FEATURE_COUNT];
+extern double eval_weights[FEATURE_COUNT];
+
+/* The stones of each colour, and how many lines they occupy: rows for White, columns for Black */
+/* (a player who has won occupies every one of them), and the fewest empty hexes on a line */
+/* across the grid that the opponent hasn't blocked: a column for White, a row for Black (INF if none) */
+typedef struct stone_count {
+  int stones[2], lines[2], open[2];
+} stone_count;
+
+void count_stones(stone_count *);
+
+/* White's evaluation: the weighted sum of the features, times EVAL_SCALE. Features are computed */
+/* lazily, from the cheapest, until the value is known to lie inside or outside the window */
+/* (alpha, beta) (White's): <lower> and <upper> get the bounds found (equal, once it's exact) */
+void weighted_evaluate(const stone_count *, int, int, int *, int *);
+void compute_features(double *, bool); /* Computes every feature (or only those with non-zero weights) */
+void compute_features_batch(int, char ***, double *); /* Computes every feature of a batch of grids */
+void distance_batch(int, char ***, int, int *); /* hexes_needed_to_win_difference(W) of a batch of grids */
+
+/* Weights files contain one "<feature name> <weight>" line per feature ('#' starts a comment) */
+int load_weights(char *, double *);
+int save_weights(char *, double *);
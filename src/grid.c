@@ -1,11 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "hex.h"
 #include "grid.h"
 #include "directives.h"
+#include "patterns.h"
 
-extern game_t game;
+#define CACHE_LINE 64
+
+/* The neighbours' offsets, in the ring order of patterns.h */
+static const int ring[PT_NEIGHBOURS][2] = {{-1, 0}, {-1, 1}, {0, 1}, {1, 0}, {1, -1}, {0, -1}};
+
+int neighbour[MAX_DIMENSION+1][DIRECTIONS];
+
+/* Zobrist keys: one per (cell, colour) pair, plus one per grid size so that */
+/* equal stone patterns on different grids never share a key */
+static uint64_t zobrist[MAX_CELLS][2];
+static uint64_t zobrist_size[MAX_DIMENSION+1];
+static uint64_t zobrist_white_to_move;
 
 void print_grid(void) {
   int i, j;
@@ -25,8 +38,7 @@ void print_grid(void) {
   printf("W H I T E\n");
 
   space_pad(4);
-  for(i = 0; i < game.dimension; i++) /* Prints the letters */
-    printf("%c%s", ('A' + i), (i == game.dimension-1) ? "\n" : "   ");
+  print_column_labels();
 
   space_pad(4);
   for(i = 0; i < game.dimension; i++) /* Prints the first row of underscores */
@@ -43,7 +55,8 @@ void print_grid(void) {
     /* Prints the lines containing the vertical bar '|' */
     printf("%d ", i+1); /* Prints the left row index */
     for(j = 0; j <= game.dimension; j++) {
-      hex_cell[1] = game.grid[i][j];
+      if(j < game.dimension)
+        hex_cell[1] = game.grid[i][j];
       printf("|%s", (j == game.dimension) ? " " : hex_cell);
     }
     printf("%d", i+1); /* Prints the right row index */
@@ -73,32 +86,218 @@ void print_grid(void) {
   }
 
   space_pad(indent);
-  for(i = 0; i < game.dimension; i++) /* Prints the letters */
-    printf("%c%s", ('A' + i), (i == game.dimension-1) ? "\n" : "   ");
+  print_column_labels();
 
   putchar('\n');
 }
 
-/* Allocates memory for the game grid and initializes it with empty_grid() */
-void init_grid(void) {
-  if(!(game.grid = malloc(sizeof(char *) * game.dimension))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
+/* Prints the column labels, each one taking up the width of a hex cell */
+void print_column_labels(void) {
+  char label[MAX_MOVE_STR];
+
+  for(int i = 0; i < game.dimension; i++) {
+    printf("%s", column_label(i, label));
+    if(i == game.dimension-1)
+      putchar('\n');
+    else
+      space_pad(4 - strlen(label));
   }
-  for(int i = 0; i < game.dimension; i++)
-    if(!(game.grid[i] = malloc(sizeof(char) * game.dimension))) {
-      print_error(MEMALLOC_ERROR);
-      exit(EXIT_FAILURE);
-    }
+}
 
+/* Makes a grid (of game.dimension, from alloc_grid()) the game's, and empties it */
+void set_grid(char **grid) {
+  game.grid = grid;
+  game.cells = &game.grid[-1][-1];
   empty_grid();
 }
 
+/* Allocates memory for the game grid and initializes it with empty_grid(). Returns FALSE if there's no memory */
+bool init_grid(void) {
+  char **grid;
+
+  if(!(grid = alloc_grid(game.dimension)))
+    return FALSE;
+  set_grid(grid);
+  return TRUE;
+}
+
+/* Empties the grid, changing it for one of <dimension> if that's another size (the engine's first */
+/* grid isn't freed: its game keeps it). Returns FALSE, leaving the grid as it was, if there's no memory */
+bool resize_grid(int dimension) {
+  char **grid;
+
+  if(dimension == game.dimension) {
+    empty_grid();
+    return TRUE;
+  }
+
+  if(!(grid = alloc_grid(dimension)))
+    return FALSE;
+  if(game.grid != engine->first_game.grid)
+    free_grid(game.grid);
+
+  game.dimension = dimension;
+  set_grid(grid);
+  return TRUE;
+}
+
+/* A grid is one cache-aligned block: the row pointers, then the cells (see STRIDE()), whose */
+/* border is filled with BORDER so that neighbour loops need no bounds checks */
+char **alloc_grid(int n) {
+  size_t rows = (sizeof(char *) * STRIDE(n) + CACHE_LINE-1) & ~(size_t) (CACHE_LINE-1);
+  size_t cells = (STRIDE(n)*STRIDE(n) + CACHE_LINE-1) & ~(size_t) (CACHE_LINE-1);
+  char **row, *cell;
+
+  if(!(row = aligned_alloc(CACHE_LINE, rows + cells)))
+    return NULL;
+
+  cell = (char *) row + rows;
+  memset(cell, BORDER, STRIDE(n)*STRIDE(n));
+  for(int i = 0; i < STRIDE(n); i++)
+    row[i] = cell + i*STRIDE(n) + 1;
+  return row + 1;
+}
+
+void free_grid(char **grid) {
+  free(grid - 1);
+}
+
+void copy_grid(char **to, char **from, int n) {
+  memcpy(&to[-1][-1], &from[-1][-1], STRIDE(n)*STRIDE(n));
+}
+
 /* Fills the game grid with spaces (denoting empty hex cells) */
 void empty_grid(void) {
   for(int i = 0; i < game.dimension; i++)
-    for(int j = 0; j < game.dimension; j++)
+    for(int j = 0; j < game.dimension; j++) {
       game.grid[i][j] = ' ';
+
+      /* Only the edges show in an empty grid's patterns */
+      game.pattern[i*game.dimension + j] = 0;
+      for(int d = 0; d < PT_NEIGHBOURS; d++) {
+        int row = i + ring[d][0], col = j + ring[d][1];
+
+        if(row < 0 || row >= game.dimension)
+          game.pattern[i*game.dimension + j] |= PT_WHITE << 2*d;
+        else if(col < 0 || col >= game.dimension)
+          game.pattern[i*game.dimension + j] |= PT_BLACK << 2*d;
+      }
+    }
+
+  for(int t = 0; t < SYMMETRIES; t++)
+    game.hash[t] = zobrist_size[game.dimension];
+}
+
+/* Places <hex> ('w', 'b' or ' ') at the given cell, keeping game.hash and the neighbours' */
+/* patterns up to date */
+void set_hex(int row, int col, char hex) {
+  char old = game.grid[row][col];
+  int state = (hex == ' ') ? PT_EMPTY : (hex == 'w') ? PT_WHITE : PT_BLACK;
+
+  /* The cell is its neighbour's neighbour in the opposite direction */
+  for(int d = 0; d < PT_NEIGHBOURS; d++) {
+    int n_row = row + ring[d][0], n_col = col + ring[d][1], shift = 2*((d + PT_NEIGHBOURS/2) % PT_NEIGHBOURS);
+
+    if(game.grid[n_row][n_col] != BORDER) {
+      unsigned short *pattern = &game.pattern[n_row*game.dimension + n_col];
+      *pattern = (*pattern & ~(3 << shift)) | state << shift;
+    }
+  }
+
+  for(int t = 0; t < SYMMETRIES; t++) {
+    int t_row = row, t_col = col;
+    int swap = swaps_colours(t);
+
+    transform_cell(t, &t_row, &t_col);
+    if(old != ' ')
+      game.hash[t] ^= zobrist[t_row*MAX_DIMENSION + t_col][(old == 'w') ^ swap];
+    if(hex != ' ')
+      game.hash[t] ^= zobrist[t_row*MAX_DIMENSION + t_col][(hex == 'w') ^ swap];
+  }
+
+  game.grid[row][col] = hex;
+}
+
+void transform_cell(int t, int *row, int *col) {
+  int n = game.dimension, temp = *row;
+
+  switch(t) {
+    case ROTATE_180:
+      *row = n-1 - *row;
+      *col = n-1 - *col;
+      break;
+    case TRANSPOSE_SWAP:
+      *row = *col;
+      *col = temp;
+      break;
+    case ANTITRANSPOSE_SWAP:
+      *row = n-1 - *col;
+      *col = n-1 - temp;
+      break;
+  }
+}
+
+/* Returns the smallest of the position's keys over all symmetries, storing the symmetry that */
+/* gives it in <transform>. Equivalent positions share the same canonical key, so position-keyed */
+/* stores hold one entry for all of them. If <with_mover> is set, the key also covers the player */
+/* to move (who is swapped along with the colours) */
+uint64_t canonical_key(bool with_mover, int *transform) {
+  uint64_t best = 0;
+
+  for(int t = 0; t < SYMMETRIES; t++) {
+    uint64_t key = game.hash[t];
+    if(with_mover && (game.current_player ^ swaps_colours(t)) == W)
+      key ^= zobrist_white_to_move;
+
+    if(t == IDENTITY || key < best) {
+      best = key;
+      *transform = t;
+    }
+  }
+
+  return best;
+}
+
+/* Checks whether a colour-preserving symmetry maps the grid onto itself */
+bool is_symmetric(int t) {
+  if(game.hash[t] != game.hash[IDENTITY])
+    return FALSE;
+
+  /* The keys match, so this is almost certainly symmetric: confirm it cell by cell */
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++) {
+      int t_row = i, t_col = j;
+      transform_cell(t, &t_row, &t_col);
+      if(game.grid[i][j] != game.grid[t_row][t_col])
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Steps a splitmix64 generator (used instead of rand(), so that the game's random sequence is unaffected) */
+static uint64_t splitmix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* Fills the Zobrist key table (the keys are the same across runs) and the neighbour offsets */
+void init_tables(void) {
+  uint64_t state = 0x4845582D4149ULL;
+
+  for(int i = 0; i < MAX_CELLS; i++) {
+    zobrist[i][0] = splitmix64(&state);
+    zobrist[i][1] = splitmix64(&state);
+  }
+  for(int i = 0; i <= MAX_DIMENSION; i++)
+    zobrist_size[i] = splitmix64(&state);
+  zobrist_white_to_move = splitmix64(&state);
+
+  for(int n = MIN_DIMENSION; n <= MAX_DIMENSION; n++)
+    for(int d = 0; d < DIRECTIONS; d++)
+      neighbour[n][d] = ring[d][0]*STRIDE(n) + ring[d][1];
 }
 
 /* Prints a specified number of space characters */
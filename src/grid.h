@@ -1,4 +1,18 @@
 void print_grid(void); /* Prints the hex board */
-void init_grid(void); /* Allocates memory for the game grid and initializes it with empty_grid() */
+void print_column_labels(void);
+bool init_grid(void); /* Allocates memory for the game grid and initializes it with empty_grid() (FALSE if there's no memory) */
+bool resize_grid(int); /* Empties the grid, changing its size if need be (FALSE, leaving it as it was, if there's no memory) */
+void set_grid(char **); /* Makes a grid (of game.dimension) the game's, and empties it */
+char **alloc_grid(int); /* Allocates a bordered grid of the given size (its cells are left unset), or returns NULL */
+void free_grid(char **);
+void copy_grid(char **, char **, int); /* Copies a grid's cells onto another grid of the same size */
 void empty_grid(void); /* Fills the game grid with spaces (denoting empty hex cells) */
+void set_hex(int, int, char); /* Places (or removes) a hex, keeping game.hash up to date */
+void transform_cell(int, int *, int *); /* Maps a cell through a symmetry (every symmetry is its own inverse) */
+uint64_t canonical_key(bool, int *); /* The smallest of the position's symmetric keys, and the symmetry that gives it */
+bool is_symmetric(int); /* Checks whether the grid is unchanged by a (colour-preserving) symmetry */
+void init_tables(void); /* Fills the Zobrist keys (independently of rand()) and the neighbour offsets */
+
+/* neighbour[n][d] is the offset, in the cells of an n x n grid, of the neighbour in direction d */
+extern int neighbour[MAX_DIMENSION+1][DIRECTIONS];
 void space_pad(unsigned); /* Prints a specified number of space characters */
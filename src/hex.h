@@ -1,6 +1,24 @@
 #include <limits.h>
+#include <stdint.h>
 #define INF INT_MAX /* Represents infinity */
 
+#define MIN_DIMENSION  4
+#define MAX_DIMENSION 64 /* Columns past Z are labelled AA, AB, .., BL (spreadsheet-style) */
+#define MAX_CELLS (MAX_DIMENSION*MAX_DIMENSION)
+#define MAX_MOVE_STR 16 /* Fits a two-letter column label, any int row and the '\0' */
+
+/* The grid's cells are stored row by row in one array, with a border of BORDER cells around */
+/* them: cell (row, col) of an n x n grid is cells[(row+1)*(n+2) + col+1] */
+#define BORDER '#'
+#define STRIDE(n) ((n)+2)
+#define MAX_BORDERED_CELLS (STRIDE(MAX_DIMENSION)*STRIDE(MAX_DIMENSION))
+#define cell_of(row, col) (((row)+1)*STRIDE(game.dimension) + (col)+1)
+#define cell_row(cell) ((cell)/STRIDE(game.dimension) - 1)
+#define cell_col(cell) ((cell)%STRIDE(game.dimension) - 1)
+
+/* The directions of a cell's neighbours (in the ring order of patterns.h) */
+enum {UP, UP_RIGHT, RIGHT, DOWN, DOWN_LEFT, LEFT, DIRECTIONS};
+
 #define PRINT_PATH 1 /* Determines whether game_finished() will print the winning path or not */
 
 typedef enum {B, W} Colour;
@@ -9,69 +27,196 @@ typedef unsigned bool;
 #define TRUE  1
 #define FALSE 0
 
+/* Symmetries of a Hex position: the colour-swapping ones also swap the player to move */
+#define SYMMETRIES         4
+#define IDENTITY           0
+#define ROTATE_180         1 /* (row, col) -> (N-1-row, N-1-col) */
+#define TRANSPOSE_SWAP     2 /* (row, col) -> (col, row), with the colours swapped */
+#define ANTITRANSPOSE_SWAP 3 /* (row, col) -> (N-1-col, N-1-row), with the colours swapped */
+
+#define swaps_colours(t) ((t) >= TRANSPOSE_SWAP)
+
 typedef struct game_t {
   int dimension;
   int difficulty;
+  int level; /* The difficulty ladder's level (see LEVELS), or 0 if cont() searches <difficulty> plies deep */
   Colour user;
   Colour current_player;
   enum {OFF, ON} swap;
-  char **grid;
+  char **grid; /* Row pointers into <cells>: grid[-1..dimension][-1..dimension] are all valid */
+  char *cells;
+  uint64_t hash[SYMMETRIES]; /* Zobrist keys of the grid's stones, as seen through each symmetry */
+  unsigned short pattern[MAX_CELLS]; /* Each cell's neighbourhood, as a patterns.h index (row*dimension + col) */
 } game_t; /* Contains info about the game's settings */
 
-typedef struct move_list *Listptr;
-typedef struct move_list {
+typedef struct move {
   int row, col;
   Colour player_clr;
-  Listptr next_move;
-} Move; /* Linked list containing info about the game's moves sequence */
-
-int minimax(int, bool, int, int, Move *, int *);
+} Move; /* A move of the game (or a search's result) */
+
+/* A position, as the history keeps one every SNAPSHOT_INTERVAL plies (see history.h) */
+typedef struct snapshot {
+  Colour player; /* The player to move */
+  uint64_t hash[SYMMETRIES];
+  unsigned short *pattern; /* The grid's dimension^2 patterns, followed in the same block by .. */
+  char *cells; /* .. its bordered cells */
+} snapshot;
+
+/* The game's moves, with snapshots of its positions to jump between them (see history.h) */
+typedef struct history_t {
+  Move *moves; /* moves[0..length): the first <ply> of them are on the grid, the rest can be replayed */
+  int ply, length, size;
+  snapshot *snapshots; /* snapshots[k] is the position at ply k*SNAPSHOT_INTERVAL */
+  int snapshot_count, snapshot_size;
+  bool swapped; /* The swap rule was used: it applies again whenever the game goes back to ply 0 */
+} history_t;
+
+#define MAX_PV 32 /* Longest principal variation tracked by the search (HEX_MAX_PV in libhex.h) */
+#define MAX_LINES 8 /* Most best moves a search can rank (HEX_MAX_LINES in libhex.h) */
+
+/* A node of the search tree that is being explored (what a recursive minimax call would keep on */
+/* the C stack), so that a search can be suspended between any two nodes and resumed later */
+typedef struct search_frame {
+  int depth; /* Plies left below this node */
+  bool maximizing;
+  int a, b; /* The alpha-beta window */
+  int best; /* The best evaluation found so far (max_eval or min_eval) */
+  int moves, move_cnt, m; /* The node's moves are move_stack[moves..moves+move_cnt), m is the current one */
+} search_frame;
+
+/* One of the root's best moves, with its score and principal variation (pv[0] is the move) */
+typedef struct search_line {
+  int score;
+  int pv[MAX_PV], pv_length;
+} search_line;
+
+/* A search in progress (see search_start()) */
+typedef struct search_state {
+  bool finished;
+  int max_difficulty; /* The search's depth (game.difficulty is the current iteration's) */
+  int saved_difficulty; /* The game's difficulty, restored when the search ends */
+  int critical; /* Set to INF or -INF when the root has a winning move, or must block one */
+  int score, completed_depth;
+  Move best_move;
+  Move completed_move; /* The best move of the last completed iteration */
+  long nodes;
+  long max_nodes; /* If set, the search ends after this many nodes, and the clock is ignored */
+  bool stopped; /* search_stop() was called */
+  bool out_of_memory; /* The search's stacks couldn't grow, so it was cut short */
+
+  int beam; /* How many of the root's moves a selective search tries (0: every node is searched at full width) */
+  int forced; /* The root's only move, a block the tactical pre-search found (-1: none) */
+  bool verifying; /* A selective search's last iteration, which re-searches its move at full width */
+
+  int lines; /* How many of the root's best moves are ranked (1: only the best one is searched for) */
+  search_line line[MAX_LINES]; /* The current iteration's best moves, best first */
+  search_line best_line[MAX_LINES]; /* .. and the last completed iteration's */
+  int line_count, best_line_count;
+  double suspended_at;
+
+  uint64_t key; /* The persistent cache's key for the root position */
+  int transform;
+
+  search_frame *frames; /* The path from the root to the current node */
+  int frame_count, frame_size;
+  int *move_stack; /* Every frame's moves */
+  int move_stack_size;
+} search_state;
+
+/* An engine context (the hex_engine of libhex.h): one game and the state of its searches */
+typedef struct hex_engine {
+  game_t game;
+  game_t first_game; /* Saves the game settings the engine started with */
+  history_t history;
+
+  double timer; /* When the current search started (see wall_time()) */
+  double max_time; /* Time limit for the current search */
+  double total_time_elapsed; /* Time spent by cont() in the current game */
+  long node_limit; /* If set, cont() and suggest() search this many nodes, whatever the time they take */
+  double time_cap; /* If set, searches with a node budget still end after this many seconds */
+  long budget_nodes; /* The last node budget that a search ran out of (or hit the time cap with), */
+  int budget_depth; /* and the depth it completed: the persistent cache asks that of the next such search */
+  bool quiet; /* The interactive game prints no boards or prompts, and flushes its output only when full */
+
+  struct hex_table *table; /* The transposition table in use: its own, or a shared one */
+  struct hex_table *own_table;
+
+  int pv[MAX_PV][MAX_PV], pv_length[MAX_PV]; /* Triangular principal variation table, by ply */
+  int best_pv[MAX_PV], best_pv_length; /* The last completed iteration's variation (cells) */
+
+  bool searching; /* A libhex search is under way: the grid holds its simulated moves */
+  search_state search;
+} engine_t;
+
+/* The engine the calling thread is working on (every libhex call selects its own). */
+/* Like errno, game names a per-thread object: the current engine's game */
+extern _Thread_local engine_t *engine;
+#define game (engine->game)
+
+engine_t *engine_new(void); /* Allocates an engine without a grid and makes it the current one */
+bool play_move(int, int); /* Places a stone for the player to move and records the move (FALSE if there's no memory) */
+
+/* Iterative deepening alpha-beta (minimax) search, run on an explicit stack: search_start() sets */
+/* it up and search_run() runs it for a number of nodes at a time, until it's over */
+void search_start(int, int, long);
+bool search_run(long);
+void search_stop(void); /* Makes the search end at the next node, as if its budget had run out */
+void search_free(void); /* Frees the stacks kept for the engine's searches */
+int search(Move *); /* Runs a whole search, returning the best move's score */
+int generate_moves(int *, bool, Colour); /* Lists a player's sensible moves, optionally ordered best-first */
+
+/* Grids bigger than MAX_DIM are searched selectively: each node only tries its best few moves by */
+/* a cheap score, BEAM_WIDTH at the root and half as many at each ply below, down to BEAM_MIN_WIDTH */
+#define BEAM_WIDTH 24
+#define BEAM_MIN_WIDTH 4
+#define VERIFY_DEPTH 2 /* How deep a selective search's move is re-searched at full width */
 
 #define MOVE_TIME_LIMIT 30.0 /* Maximum time limit for each of the player-computer's moves */
 #define TOTAL_TIME_LIMIT (60.0*game.dimension/2.0) /* Maximum total time for all of the player-computer's moves */
 #define TIME_THRESHOLD 20.0 /* Determines when the computer will start playing very quickly */
 
-#define calc_time(a) ((double) (clock() - (a)) / CLOCKS_PER_SEC)
+/* Searches are timed by the wall clock: clock() would count every thread's time */
+double wall_time(void);
+#define calc_time(a) (wall_time() - (a))
 
 double optimal_time_limit(double); /* Computes the time limit for each of the computer's moves */
 
-int static_evaluate(Colour); /* Evaluates the quality of a grid state for a player */
+/* The difficulty ladder: at level k (1 to LEVELS), the computer answers within level_seconds[k-1] */
+/* seconds on any machine, and searches as many nodes as this machine searches (as measured by */
+/* calibrate()) in LEVEL_SHARE of that time, so that its moves don't depend on the load */
+#define LEVELS 10
+#define LEVEL_SHARE 0.75
+extern const double level_seconds[LEVELS];
+
+int static_evaluate(Colour, int, int); /* Evaluates the quality of a grid state for a player, within a window */
 
 int hexes_needed_to_win_difference(Colour);
-int transition_cost(int, int, Colour);
-void init_cost_matrix(int **, Colour);
+int transition_cost(int, Colour);
+void init_cost_matrix(int *, Colour);
 
 int add(int, int);
 int min(int, int);
 int max(int, int);
 
 int max_seq_length_difference(Colour);
-int compute_sequence_length(int, int, char, bool **);
+int compute_sequence_length(int, char, bool *);
 
 bool game_finished(bool, Colour); /* Checks whether a player's sides are connected */
 
 /* Checks whether a hex at one side is connected to the opposing side (DFS) */
-bool evaluate_game(int, int, char, bool **, int *, int *);
+bool evaluate_game(int, char, bool *, int *, int *);
 
-bool is_whitespace(unsigned);
-bool valid_coordinates(int, int);
-bool is_neighbour(int, int, char);
 bool is_digit(unsigned);
+bool is_upper(unsigned);
+
+/* Conversions between grid indeces and move strings (eg. "B7", "AC12") */
+char *move_str(int, int, char *);
+char *column_label(int, char *);
+int parse_move(char *, int *, int *);
 
-void process_CLA(int argc, char **argv); /* Parses and processes Command Line Arguments */
-void skip_whitespace(void);
 void input_flush(void); /* Reads input characters until '\n' is read (for error-handling) */
 
 void print_current_player(void);
 void print_winner(int *, int *);
 void print_error(int);
-
-/* Utility functions for deallocating two-dimensional arrays */
-void dealloc_char(int, char **);
-void dealloc_bool(int, bool **);
-
-/* Linked list utility functions */
-void insert_at_end(Listptr *, Listptr *, int, int);
-void remove_last_node(Listptr *, Listptr *);
-void delete_move_list(Listptr *);
-int  move_count(Listptr);
+const char *error_message(int);
@@ -0,0 +1,150 @@
+/* hexnet: creates network weight files and benchmarks the network's inference kernels
+ *
+ *   hexnet init <weights> [<channels> [<blocks>]]  writes a randomly initialised network
+ *   hexnet bench <weights> [<size> [<seconds>]]     reports positions/sec per core for each kernel
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hex.h"
+#include "network.h"
+
+#define DEFAULT_CHANNELS 32
+#define DEFAULT_BLOCKS    2
+
+#define cpu_seconds(a) ((double) (clock() - (a)) / CLOCKS_PER_SEC)
+
+static uint64_t rng_state = 0x6865786E6574ULL;
+
+static uint64_t next_random(void) {
+  uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* Writes <count> random int8 weights in [-range, range] */
+static void write_weights(FILE *file, size_t count, int range) {
+  while(count--)
+    putc((int8_t) ((int) (next_random() % (2*range + 1)) - range), file);
+}
+
+static void write_zeros(FILE *file, size_t count) {
+  while(count--)
+    putc(0, file);
+}
+
+static int init(char *filename, int channels, int blocks) {
+  if(channels <= 0 || channels % NN_CHANNEL_ALIGN || channels > NN_MAX_CHANNELS || blocks < 0 || blocks > 64) {
+    fprintf(stderr, "hexnet: channels must be a positive multiple of %d (at most %d), blocks at most 64\n",
+            NN_CHANNEL_ALIGN, NN_MAX_CHANNELS);
+    return EXIT_FAILURE;
+  }
+
+  FILE *file;
+  if(!(file = fopen(filename, "wb"))) {
+    fprintf(stderr, "hexnet: %s cannot be opened\n", filename);
+    return EXIT_FAILURE;
+  }
+
+  nn_header header = {NN_MAGIC, NN_VERSION, channels, blocks, 6, 8, {0, 0}};
+  fwrite(&header, sizeof(header), 1, file);
+
+  for(int l = 0; l < 1 + 2*blocks; l++) {
+    write_weights(file, (size_t) NN_TAPS*channels*channels, 8);
+    write_zeros(file, sizeof(int32_t)*channels); /* Biases */
+  }
+
+  for(int head = 0; head < 2; head++) { /* Policy and value heads */
+    write_weights(file, channels, 16);
+    write_zeros(file, sizeof(int32_t)*8);
+  }
+
+  fclose(file);
+  printf("%s: %d channels, %d residual blocks, %zu bytes\n", filename, channels, blocks, nn_file_size(channels, blocks));
+  return EXIT_SUCCESS;
+}
+
+static int bench(char *filename, int dimension, double seconds) {
+  nn_network *net;
+  if(!(net = nn_load(filename))) {
+    fprintf(stderr, "hexnet: %s is not a valid weights file\n", filename);
+    return EXIT_FAILURE;
+  }
+  if(dimension < MIN_DIMENSION || dimension > MAX_DIMENSION) {
+    fprintf(stderr, "hexnet: invalid dimension\n");
+    nn_free(net);
+    return EXIT_FAILURE;
+  }
+
+  /* A batch of random, half-filled grids */
+  char **grids[NN_MAX_BATCH];
+  for(int p = 0; p < NN_MAX_BATCH; p++) {
+    grids[p] = malloc(sizeof(char *) * dimension);
+    for(int i = 0; i < dimension; i++) {
+      grids[p][i] = malloc(dimension);
+      for(int j = 0; j < dimension; j++)
+        grids[p][i][j] = " wb "[next_random() % 4];
+    }
+  }
+
+  int reference[NN_MAX_BATCH], values[NN_MAX_BATCH];
+  const char *names[] = {"avx2", "ssse3", "scalar"};
+  bool have_reference = FALSE;
+
+  printf("%s: %d channels, %d residual blocks, %dx%d grid, batches of %d\n",
+         filename, net->channels, net->blocks, dimension, dimension, NN_MAX_BATCH);
+
+  for(int k = 0; k < 3; k++) {
+    if(!nn_select_kernel(names[k])) {
+      printf("%8s: not supported by this CPU\n", names[k]);
+      continue;
+    }
+
+    /* Every kernel must produce exactly the same values */
+    if(!nn_evaluate_batch(net, NN_MAX_BATCH, grids, dimension, values, NULL)) {
+      fprintf(stderr, "hexnet: memory allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    if(!have_reference) {
+      memcpy(reference, values, sizeof(values));
+      have_reference = TRUE;
+    }
+    else if(memcmp(reference, values, sizeof(values))) {
+      printf("%8s: MISMATCH against the %s kernel\n", names[k], nn_kernel_name());
+      continue;
+    }
+
+    long positions = 0;
+    clock_t timer = clock(); /* Processor time, since the throughput is per core */
+    do {
+      nn_evaluate_batch(net, NN_MAX_BATCH, grids, dimension, values, NULL); /* Its planes are allocated by now */
+      positions += NN_MAX_BATCH;
+    } while(cpu_seconds(timer) < seconds);
+
+    printf("%8s: %.0f positions/sec per core\n", names[k], positions / cpu_seconds(timer));
+  }
+
+  for(int p = 0; p < NN_MAX_BATCH; p++) {
+    for(int i = 0; i < dimension; i++)
+      free(grids[p][i]);
+    free(grids[p]);
+  }
+  nn_free(net);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+  if(argc >= 3 && argc <= 5 && !strcmp(argv[1], "init"))
+    return init(argv[2], (argc > 3) ? atoi(argv[3]) : DEFAULT_CHANNELS, (argc > 4) ? atoi(argv[4]) : DEFAULT_BLOCKS);
+
+  if(argc >= 3 && argc <= 5 && !strcmp(argv[1], "bench"))
+    return bench(argv[2], (argc > 3) ? atoi(argv[3]) : 11, (argc > 4) ? atof(argv[4]) : 1.0);
+
+  fprintf(stderr, "Usage: %s init <weights> [<channels> [<blocks>]]\n", argv[0]);
+  fprintf(stderr, "       %s bench <weights> [<size> [<seconds>]]\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,151 @@
+/* hexopen: builds the first-move table, with which the agent applies the swap rule (load it with hex -o)
+ *
+ *   hexopen <table> <size>[:<nodes>] [<size>[:<nodes>] ...]
+ *       values every first move on a <size> x <size> grid: moves the solver settles within
+ *       OPENING_SOLVE_LIMIT nodes are won or lost outright, and the others are searched for
+ *       <nodes> nodes each (OPENING_NODES by default), in parallel on every processor
+ *
+ * A move and its 180-degree rotation have the same value, so only one of the two is valued.
+ * The searches are limited by nodes rather than time, so the table is the same on any machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "libhex.h"
+#include "grid.h"
+#include "directives.h"
+#include "solver.h"
+#include "openings.h"
+
+#define OPENING_NODES 200000
+#define OPENING_SOLVE_LIMIT 10000000
+
+static int16_t values[MAX_CELLS];
+
+/* The searches still running on the scheduler */
+static int pending;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+/* White's value of a first move, from Black's score of the position that follows it */
+static int16_t white_value(int score) {
+  if(score == INF)
+    return -OB_WIN;
+  if(score == -INF)
+    return OB_WIN;
+  return -max(-(OB_WIN-1), min(OB_WIN-1, score));
+}
+
+/* Runs on one of the scheduler's threads, with the move's cell as <data> */
+static void done(hex_engine *e, const hex_result *result, void *data) {
+  values[(intptr_t) data] = white_value(result->score);
+  hex_destroy(e);
+
+  pthread_mutex_lock(&lock);
+  if(!--pending)
+    pthread_cond_signal(&finished);
+  pthread_mutex_unlock(&lock);
+}
+
+int main(int argc, char **argv) {
+  ob_header header = {OB_MAGIC, OB_VERSION, argc-2, 0};
+  ob_table tables[OB_MAX_TABLES];
+  int dimensions[OB_MAX_TABLES];
+  long nodes[OB_MAX_TABLES];
+  FILE *file;
+
+  if(argc < 3 || argc-2 > OB_MAX_TABLES) {
+    fprintf(stderr, "Usage: %s <table> <size>[:<nodes>] [<size>[:<nodes>] ...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(int t = 0; t < argc-2; t++) {
+    int fields = sscanf(argv[t+2], "%d:%ld", &dimensions[t], &nodes[t]);
+
+    if(fields == 1)
+      nodes[t] = OPENING_NODES;
+    if(fields < 1 || dimensions[t] < MIN_DIMENSION || dimensions[t] > MAX_DIMENSION || nodes[t] < 1) {
+      fprintf(stderr, "hexopen: invalid table %s\n", argv[t+2]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(!(file = fopen(argv[1], "wb"))) {
+    fprintf(stderr, "hexopen: %s cannot be opened\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  hex_scheduler *scheduler = hex_scheduler_create((int) sysconf(_SC_NPROCESSORS_ONLN));
+
+  /* The header and the table directory are written last, once the offsets are known */
+  uint64_t offset = sizeof(header) + header.table_count*sizeof(ob_table);
+  fseek(file, offset, SEEK_SET);
+
+  for(int t = 0; t < argc-2; t++) {
+    int n = dimensions[t], solved = 0, searched = 0;
+    hex_limits limits = {n*n, 0, 1, nodes[t]};
+    double start = wall_time();
+
+    solver_clear();
+
+    /* The solver runs on this thread while the scheduler's threads search */
+    for(int c = 0; c <= (n*n-1)/2; c++) {
+      char move[MAX_MOVE_STR];
+      hex_engine *e = hex_create(n);
+
+      if(!e) {
+        print_error(MEMALLOC_ERROR);
+        exit(EXIT_FAILURE);
+      }
+      hex_play(e, move_str(c / n, c % n, move));
+
+      if(n <= SOLVER_MAX_DIMENSION) {
+        bitboard_t bb;
+        int cell, result;
+
+        engine = e;
+        to_bitboard(&bb);
+        if((result = solve(&bb, B, OPENING_SOLVE_LIMIT, &cell, NULL)) >= 0) {
+          values[c] = result ? -OB_WIN : OB_WIN;
+          hex_destroy(e);
+          solved++;
+          continue;
+        }
+      }
+
+      pthread_mutex_lock(&lock);
+      pending++;
+      pthread_mutex_unlock(&lock);
+
+      hex_scheduler_submit(scheduler, e, &limits, 1, done, (void *) (intptr_t) c);
+      searched++;
+    }
+
+    pthread_mutex_lock(&lock);
+    while(pending)
+      pthread_cond_wait(&finished, &lock);
+    pthread_mutex_unlock(&lock);
+
+    for(int c = (n*n-1)/2 + 1; c < n*n; c++)
+      values[c] = values[n*n-1 - c];
+
+    tables[t] = (ob_table) {n, 0, offset};
+    fwrite(values, sizeof(int16_t), n*n, file);
+    offset += n*n * sizeof(int16_t);
+
+    printf("%dx%d: %d moves solved, %d searched in %.2fs\n", n, n, solved, searched, wall_time() - start);
+  }
+
+  hex_scheduler_destroy(scheduler);
+
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(tables, sizeof(ob_table), header.table_count, file);
+  fclose(file);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,443 @@
+/* hexplay: plays self-play games on every processor and writes their positions as training data
+ *
+ *   hexplay <directory> <size> <games> [-t <threads>] [-s <shards>] [-N <nodes> | -T <seconds>]
+ *           [-d <depth>] [-r <plies>] [-e <noise>] [-x <seed>]
+ *       plays <games> games on a <size> x <size> grid, on <threads> threads (every processor by
+ *       default). Each move is searched for <nodes> nodes (PLAY_NODES by default) or <seconds>
+ *       seconds, up to <depth> plies, except for the first <plies> moves of each game (the
+ *       opening, PLAY_RANDOM_PLIES by default), which are random. With probability <noise>
+ *       (0 by default), a move is drawn from the search's PLAY_NOISE_LINES best ones instead
+ *
+ * Every position of every game is written, labelled with the move played from it, White's search
+ * score (0 for random moves) and the game's result, as records of position files (positions.h):
+ * <directory>/shard-000.pos, .. (PLAY_SHARDS of them by default). Game g goes to shard
+ * g % shards, and its random choices only depend on g and <seed>, so with node budgets a run's
+ * data doesn't depend on the machine or on how many threads played it. The games are handed out
+ * to the threads one at a time, whatever their shard, and each shard's games are written in
+ * order: a game that's over before an earlier one of its shard waits for it, in memory.
+ *
+ * A run that is killed can be resumed by running the same command again. <directory>/manifest
+ * holds the run's settings, and each shard's checkpoint (shard-000.ckpt, replaced atomically
+ * once the shard's latest game is on disk) the games and records the shard holds: a resumed run
+ * truncates each shard to its checkpoint, dropping a game that was only partly written, and goes
+ * on with the shard's next game, so that no game is lost or written twice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "hex.h"
+#include "libhex.h"
+#include "directives.h"
+#include "positions.h"
+
+#define PLAY_NODES 2000
+#define PLAY_DEPTH 20
+#define PLAY_SHARDS 16
+#define PLAY_RANDOM_PLIES 2
+#define PLAY_NOISE_LINES 4
+#define PLAY_REPORT_SECONDS 10.0 /* How often the throughput is reported */
+
+#define MAX_THREADS 256
+#define MAX_SHARDS 1000
+#define MAX_PATH 4096
+
+/* The run's settings, as the manifest records them */
+typedef struct settings {
+  int dimension;
+  long games;
+  int shards;
+  long nodes;
+  double seconds;
+  int depth;
+  int random_plies;
+  double noise;
+  uint64_t seed;
+} settings;
+
+/* A game played ahead of its shard's next one */
+typedef struct finished_game {
+  long index; /* Its place in the shard */
+  int count;
+  uint8_t *records;
+} finished_game;
+
+/* Each shard is appended to under its own lock */
+typedef struct shard_t {
+  pthread_mutex_t lock;
+  long games, records; /* On disk, as the checkpoint records them */
+  long resumed_games; /* Those played before the run was resumed */
+  finished_game *waiting; /* Until the games before them are written */
+  int waiting_count, waiting_size;
+} shard_t;
+
+static settings run;
+static char *directory;
+static shard_t *shards;
+
+/* Games are handed out to the threads one at a time, in order */
+static long next_game;
+static long games_played, positions_written; /* In this session */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void shard_path(char *path, int shard, const char *extension) {
+  snprintf(path, MAX_PATH, "%s/shard-%03d.%s", directory, shard, extension);
+}
+
+/* White's score of a search result (positions.h keeps 16 bits: forced results are the extremes) */
+static int white_score(int score, int mover) {
+  if(score == INF || score == -INF)
+    score = (score == INF) ? 32767 : -32767;
+  else
+    score = max(-32000, min(32000, score));
+  return (mover == W) ? score : -score;
+}
+
+/* Plays game <g>, packing its positions into <records>, and returns their count */
+static int play_game(long g, uint8_t *records) {
+  int n = run.dimension, count = 0;
+  size_t record_size = pos_record_size(n);
+  uint64_t state = run.seed ^ (g * 0xD1B54A32D192ED03ULL);
+  hex_limits limits = {run.depth, run.seconds, (run.noise > 0.0) ? PLAY_NOISE_LINES : 1, run.nodes};
+  hex_result results[HEX_MAX_LINES];
+  hex_engine *e = hex_create(n);
+  engine_t *caller = engine;
+  char move[MAX_MOVE_STR];
+  int error;
+
+  if(!e) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  engine = e; /* game (the grid, which pos_pack() reads) is the current engine's, until the game is over */
+  while(hex_winner(e) < 0) {
+    int cell, score = 0;
+
+    if(count < run.random_plies) {
+      do
+        cell = next_random(&state) % (n*n);
+      while(game.grid[cell / n][cell % n] != ' ');
+    }
+    else {
+      int k = 0;
+
+      if((error = hex_search(e, &limits, &results[0]))) {
+        print_error(error);
+        exit(EXIT_FAILURE);
+      }
+      if(run.noise > 0.0 && (next_random(&state) >> 11) * 0x1.0p-53 < run.noise)
+        k = next_random(&state) % hex_search_lines(e, results);
+
+      cell = results[k].row*n + results[k].col;
+      score = white_score(results[k].score, hex_to_move(e));
+    }
+
+    pos_pack(records + count*record_size, 0, score, cell);
+    if((error = hex_play(e, move_str(cell / n, cell % n, move)))) {
+      print_error(error);
+      exit(EXIT_FAILURE);
+    }
+    count++;
+  }
+
+  for(int p = 0; p < count; p++)
+    records[p*record_size] = (uint8_t) (int8_t) ((hex_winner(e) == W) ? 1 : -1);
+
+  hex_destroy(e);
+  engine = caller;
+  return count;
+}
+
+/* Reads a shard's checkpoint: the games and records it holds (none if there's no checkpoint) */
+static void read_checkpoint(int shard, long *games, long *records) {
+  char path[MAX_PATH];
+  FILE *file;
+
+  *games = *records = 0;
+  shard_path(path, shard, "ckpt");
+  if((file = fopen(path, "r"))) {
+    if(fscanf(file, "%ld %ld", games, records) != 2)
+      *games = *records = 0;
+    fclose(file);
+  }
+}
+
+/* Records that the shard holds <games> games and <records> records: the checkpoint is written */
+/* to a temporary file, flushed to disk and renamed over the old one, so it's never half written */
+static void write_checkpoint(int shard, long games, long records) {
+  char path[MAX_PATH], temporary[MAX_PATH];
+  FILE *file;
+
+  shard_path(path, shard, "ckpt");
+  shard_path(temporary, shard, "ckpt.tmp");
+  if(!(file = fopen(temporary, "w"))) {
+    fprintf(stderr, "hexplay: %s cannot be written\n", temporary);
+    exit(EXIT_FAILURE);
+  }
+
+  bool written = fprintf(file, "%ld %ld\n", games, records) > 0 && !fflush(file) && !fsync(fileno(file));
+  if(fclose(file) || !written || rename(temporary, path)) {
+    fprintf(stderr, "hexplay: %s cannot be written\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* Opens a shard, cut back to its checkpoint's records (or created, if it holds none). A shard */
+/* that's shorter than its checkpoint has lost records the checkpoint counts, so it can't be resumed */
+static FILE *open_shard(int shard, long records) {
+  char path[MAX_PATH];
+  off_t size = sizeof(pos_header) + records*pos_record_size(run.dimension);
+  struct stat st;
+  FILE *file;
+
+  shard_path(path, shard, "pos");
+  if(!records)
+    return pos_create(path, run.dimension);
+
+  if(!(file = fopen(path, "r+b")) || fstat(fileno(file), &st) || st.st_size < size
+     || ftruncate(fileno(file), size) || fseek(file, 0, SEEK_END)) {
+    fprintf(stderr, "hexplay: %s cannot be resumed\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return file;
+}
+
+static void shard_error(int shard) {
+  fprintf(stderr, "hexplay: shard %d cannot be written\n", shard);
+  exit(EXIT_FAILURE);
+}
+
+/* Hands a game's records over to its shard, which appends every game that's next in line (and */
+/* only then counts them in its checkpoint, once they're on disk) */
+static void finish_game(long g, uint8_t *records, int count) {
+  int s = g % run.shards;
+  shard_t *shard = &shards[s];
+  char path[MAX_PATH];
+  FILE *file = NULL;
+
+  pthread_mutex_lock(&shard->lock);
+  if(shard->waiting_count == shard->waiting_size) {
+    shard->waiting_size = shard->waiting_size ? 2*shard->waiting_size : 8;
+    if(!(shard->waiting = realloc(shard->waiting, shard->waiting_size * sizeof(finished_game)))) {
+      print_error(MEMALLOC_ERROR);
+      exit(EXIT_FAILURE);
+    }
+  }
+  shard->waiting[shard->waiting_count++] = (finished_game) {g / run.shards, count, records};
+
+  while(TRUE) {
+    int w = 0;
+
+    while(w < shard->waiting_count && shard->waiting[w].index != shard->games)
+      w++;
+    if(w == shard->waiting_count)
+      break;
+
+    finished_game next = shard->waiting[w];
+    shard->waiting[w] = shard->waiting[--shard->waiting_count];
+
+    shard_path(path, s, "pos");
+    if((!file && !(file = fopen(path, "ab")))
+       || fwrite(next.records, pos_record_size(run.dimension), next.count, file) != (size_t) next.count)
+      shard_error(s);
+
+    shard->games++;
+    shard->records += next.count;
+    free(next.records);
+  }
+
+  if(file) {
+    if(fflush(file) || fsync(fileno(file)) || fclose(file))
+      shard_error(s);
+    write_checkpoint(s, shard->games, shard->records);
+  }
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/* The next game left to play (run.games once there are none): a shard's first resumed_games */
+/* games are already played */
+static long take_game(void) {
+  pthread_mutex_lock(&lock);
+  while(next_game < run.games && next_game / run.shards < shards[next_game % run.shards].resumed_games)
+    next_game++;
+
+  long g = (next_game < run.games) ? next_game++ : run.games;
+  pthread_mutex_unlock(&lock);
+  return g;
+}
+
+/* Plays the games it's handed */
+static void *worker(void *arg) {
+  long g;
+
+  while((g = take_game()) < run.games) {
+    uint8_t *records = malloc(pos_record_size(run.dimension) * run.dimension*run.dimension);
+
+    if(!records) {
+      print_error(MEMALLOC_ERROR);
+      exit(EXIT_FAILURE);
+    }
+
+    int count = play_game(g, records);
+    finish_game(g, records, count); /* .. which frees the records */
+
+    pthread_mutex_lock(&lock);
+    games_played++;
+    positions_written += count;
+    pthread_mutex_unlock(&lock);
+  }
+
+  return NULL;
+}
+
+/* Writes the manifest of a new run, or checks that a resumed run has the same settings */
+static bool check_manifest(void) {
+  char path[MAX_PATH];
+  settings saved = {0};
+  FILE *file;
+
+  snprintf(path, MAX_PATH, "%s/manifest", directory);
+  if(!(file = fopen(path, "r"))) {
+    if(!(file = fopen(path, "w")))
+      return FALSE;
+
+    fprintf(file, "size %d\ngames %ld\nshards %d\nnodes %ld\nseconds %.17g\ndepth %d\nrandom %d\nnoise %.17g\nseed %llu\n",
+            run.dimension, run.games, run.shards, run.nodes, run.seconds, run.depth, run.random_plies, run.noise,
+            (unsigned long long) run.seed);
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+    return TRUE;
+  }
+
+  unsigned long long seed = 0;
+  int fields = fscanf(file, "size %d games %ld shards %d nodes %ld seconds %lf depth %d random %d noise %lf seed %llu",
+                      &saved.dimension, &saved.games, &saved.shards, &saved.nodes, &saved.seconds, &saved.depth,
+                      &saved.random_plies, &saved.noise, &seed);
+  saved.seed = seed;
+  fclose(file);
+
+  return fields == 9 && saved.dimension == run.dimension && saved.games == run.games && saved.shards == run.shards
+         && saved.nodes == run.nodes && saved.seconds == run.seconds && saved.depth == run.depth
+         && saved.random_plies == run.random_plies && saved.noise == run.noise && saved.seed == run.seed;
+}
+
+static void usage(char *program) {
+  fprintf(stderr, "Usage: %s <directory> <size> <games> [-t <threads>] [-s <shards>] [-N <nodes> | -T <seconds>]"
+          " [-d <depth>] [-r <plies>] [-e <noise>] [-x <seed>]\n", program);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), option;
+  pthread_t thread[MAX_THREADS];
+
+  run = (settings) {0, 0, PLAY_SHARDS, PLAY_NODES, 0.0, PLAY_DEPTH, PLAY_RANDOM_PLIES, 0.0, 1};
+
+  if(argc < 4)
+    usage(argv[0]);
+  directory = argv[1];
+  run.dimension = atoi(argv[2]);
+  run.games = atol(argv[3]);
+
+  optind = 4;
+  while((option = getopt(argc, argv, "t:s:N:T:d:r:e:x:")) != -1)
+    switch(option) {
+      case 't': threads = atoi(optarg); break;
+      case 's': run.shards = atoi(optarg); break;
+      case 'N': run.nodes = atol(optarg); run.seconds = 0.0; break;
+      case 'T': run.seconds = atof(optarg); run.nodes = 0; break;
+      case 'd': run.depth = atoi(optarg); break;
+      case 'r': run.random_plies = atoi(optarg); break;
+      case 'e': run.noise = atof(optarg); break;
+      case 'x': run.seed = strtoull(optarg, NULL, 10); break;
+      default: usage(argv[0]);
+    }
+
+  if(optind < argc || run.dimension < MIN_DIMENSION || run.dimension > MAX_DIMENSION || run.games < 1
+     || threads < 1 || threads > MAX_THREADS || run.shards < 1 || run.shards > MAX_SHARDS
+     || (run.nodes < 1 && run.seconds <= 0.0) || run.depth < 1 || run.random_plies < 0
+     || run.noise < 0.0 || run.noise > 1.0) {
+    fprintf(stderr, "hexplay: invalid settings\n");
+    return EXIT_FAILURE;
+  }
+
+  mkdir(directory, 0777);
+  if(!check_manifest()) {
+    fprintf(stderr, "hexplay: %s holds a run with other settings (or cannot be written)\n", directory);
+    return EXIT_FAILURE;
+  }
+
+  /* Each shard is cut back to its checkpoint (or created) before any game is played */
+  if(!(shards = calloc(run.shards, sizeof(shard_t)))) {
+    print_error(MEMALLOC_ERROR);
+    return EXIT_FAILURE;
+  }
+
+  long done = 0;
+  for(int s = 0; s < run.shards; s++) {
+    shard_t *shard = &shards[s];
+    FILE *file;
+
+    pthread_mutex_init(&shard->lock, NULL);
+    read_checkpoint(s, &shard->games, &shard->records);
+    if(!(file = open_shard(s, shard->records)) || fclose(file)) {
+      fprintf(stderr, "hexplay: shard %d cannot be created\n", s);
+      return EXIT_FAILURE;
+    }
+
+    shard->resumed_games = shard->games;
+    done += shard->games;
+  }
+  if(done)
+    printf("Resuming: %ld of %ld games already played\n", done, run.games);
+
+  double start = wall_time(), last_report = start;
+
+  for(int t = 0; t < threads; t++) {
+    int error;
+
+    if((error = pthread_create(&thread[t], NULL, worker, NULL))) {
+      fprintf(stderr, "hexplay: %s\n", strerror(error));
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* The throughput is reported while the threads play */
+  while(TRUE) {
+    usleep(100000);
+
+    pthread_mutex_lock(&lock);
+    long games = games_played, positions = positions_written;
+    pthread_mutex_unlock(&lock);
+
+    bool over = (done + games == run.games);
+    if(over || wall_time() - last_report >= PLAY_REPORT_SECONDS) {
+      double elapsed = wall_time() - start;
+
+      printf("%ld of %ld games, %ld positions (%.0f games/hour)\n", done + games, run.games, positions,
+             games / elapsed * 3600.0);
+      fflush(stdout);
+      last_report = wall_time();
+    }
+    if(over)
+      break;
+  }
+
+  for(int t = 0; t < threads; t++)
+    pthread_join(thread[t], NULL);
+
+  return EXIT_SUCCESS;
+}
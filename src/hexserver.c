@@ -0,0 +1,500 @@
+/* hexserver: plays many games at once for clients connected to a Unix domain socket
+ *
+ *   hexserver <socket> [<threads> [<sessions>]]
+ *
+ * Every connection is a game session, driven by a line protocol with the directives' verbs.
+ * Each request line gets one response line, "ok [..]" or "error <message>":
+ *
+ *   newgame [black|white [swapoff|swapon [<size>]]]  ok
+ *   play <move>                  ok [white|black wins]
+ *   cont                         ok <move> [white|black wins]
+ *   suggest                      ok <move>
+ *   suggest <k>                  ok <move> <score> <variation> | <move> <score> <variation> ..
+ *                                (the k best moves; scores are numbers, "win" or "loss")
+ *   undo, swap                   ok
+ *   level [<difficulty>]         ok <difficulty>
+ *   showstate, save              ok <size> <w|b (to move)> <cells, row by row: w, b or .>
+ *   load <size> <w|b> <cells>    ok (the state, in the same form as save's)
+ *   quit                         ok (and the connection is closed)
+ *
+ * As in the interactive game, the user plays White unless told otherwise, play is for the
+ * user's moves and cont for the computer's. Sessions start like "hex" with no options.
+ *
+ * One thread multiplexes the connections with poll(); requests are queued and run by a fixed
+ * pool of worker threads, one request per session at a time (later lines wait in the session's
+ * input buffer). Every session's engine uses the same transposition table, and each session
+ * has fixed-size buffers, so a session costs a few tens of KB whatever its client does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "hex.h"
+#include "libhex.h"
+#include "directives.h"
+#include "grid.h"
+#include "history.h"
+
+#define DEFAULT_SESSIONS 512
+#define MAX_THREADS 256
+#define SERVER_TT_BITS 22 /* The shared table: 2^22 entries (64MB) */
+#define SESSION_INPUT  8192 /* Longest request line, which fits a 64x64 load */
+#define SESSION_OUTPUT 8192 /* Unsent output beyond this closes the session */
+#define MAX_ARGS 8
+
+typedef struct session_t {
+  int fd;
+  hex_engine *engine;
+  bool busy; /* A request is queued or running (the worker owns the engine) */
+  bool closing; /* Close once the request finishes and the output is sent (quit) */
+  bool dead; /* Close once the request finishes (the client left, or doesn't read) */
+  bool finished; /* The game is over (only newgame, level and quit are left) */
+
+  char input[SESSION_INPUT];
+  size_t input_len;
+  bool overlong; /* The current line didn't fit: discard it up to its '\n' */
+
+  char output[SESSION_OUTPUT];
+  size_t output_len;
+
+  struct session_t *next; /* In the request queue */
+} session_t;
+
+static session_t **sessions;
+static int session_count, max_sessions;
+
+/* Protects the sessions' flags and buffers and the request queue */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static session_t *queue_head, *queue_tail;
+
+static hex_table *table;
+static int wake[2]; /* Workers write to wake[1] when the poll set needs rebuilding */
+
+static void enqueue(session_t *s) {
+  s->busy = TRUE;
+  s->next = NULL;
+  if(queue_tail)
+    queue_tail->next = s;
+  else
+    queue_head = s;
+  queue_tail = s;
+  pthread_cond_signal(&queued);
+}
+
+/* Appends a response and sends as much output as the socket takes (called with the lock held) */
+static void respond(session_t *s, const char *text) {
+  size_t len = strlen(text);
+
+  if(s->output_len + len > SESSION_OUTPUT) {
+    s->dead = TRUE; /* The client doesn't read its responses */
+    return;
+  }
+  memcpy(s->output + s->output_len, text, len);
+  s->output_len += len;
+
+  ssize_t sent = send(s->fd, s->output, s->output_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if(sent > 0) {
+    memmove(s->output, s->output + sent, s->output_len - sent);
+    s->output_len -= sent;
+  }
+  else if(sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+    s->dead = TRUE;
+}
+
+/* Writes the game state in save's form */
+static void write_state(char *response) {
+  int len = sprintf(response, "ok %d %c ", game.dimension, (game.current_player == W) ? 'w' : 'b');
+
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++)
+      response[len++] = (game.grid[i][j] == ' ') ? '.' : game.grid[i][j];
+  strcpy(response + len, "\n");
+}
+
+/* Replaces the game with a state in save's form */
+static int load_state(char **args) {
+  int dimension;
+
+  if(!args[1] || !args[2] || !args[3] || args[4])
+    return INVALID_DIRECTIVE;
+
+  for(int i = 0; args[1][i] != '\0'; i++)
+    if(!is_digit(args[1][i]))
+      return INVALID_DIRECTIVE;
+
+  dimension = atoi(args[1]);
+  if(dimension < MIN_DIMENSION || dimension > MAX_DIMENSION)
+    return INVALID_DIMENSION;
+  if((strcmp(args[2], "w") && strcmp(args[2], "b")) || strlen(args[3]) != (size_t) dimension*dimension
+     || strspn(args[3], "wb.") != strlen(args[3]))
+    return INVALID_DIRECTIVE;
+
+  if(!resize_grid(dimension))
+    return MEMALLOC_ERROR;
+
+  for(int cell = 0; cell < dimension*dimension; cell++)
+    if(args[3][cell] != '.')
+      set_hex(cell / dimension, cell % dimension, args[3][cell]);
+
+  game.current_player = (args[2][0] == 'w') ? W : B;
+  history_clear();
+  return NO_ERROR;
+}
+
+/* After a move: reports a win (the game then waits for newgame) and passes the turn */
+static void end_move(session_t *s, char *response) {
+  Colour player = game.current_player;
+
+  if(game_finished(!PRINT_PATH, player)) {
+    s->finished = TRUE;
+    sprintf(response + strlen(response) - 1, " %s wins\n", (player == W) ? "white" : "black");
+  }
+  game.current_player ^= 1;
+}
+
+/* Runs one request line on the session's engine, writing the response line */
+static void execute(session_t *s, char *line, char *response) {
+  char *args[MAX_ARGS+1];
+  char move[MAX_MOVE_STR];
+  int argc = 0, error = NO_ERROR, dir_ind;
+  char *save_ptr;
+  Move current_move;
+
+  for(char *word = strtok_r(line, " \t\r", &save_ptr); word && argc < MAX_ARGS; word = strtok_r(NULL, " \t\r", &save_ptr))
+    args[argc++] = word;
+  args[argc] = NULL;
+
+  /* The directives work on the current engine: the session's, until the request is done */
+  engine_t *caller = engine;
+  engine = s->engine;
+  strcpy(response, "ok\n");
+  dir_ind = get_index(args);
+
+  if(s->finished && dir_ind != NEWGAME && dir_ind != LEVEL && dir_ind != QUIT
+     && dir_ind != SHOWSTATE && dir_ind != SAVE)
+    error = GAME_OVER;
+  else switch(dir_ind) {
+    case NEWGAME:
+      if(!(error = newgame(args))) {
+        history_clear();
+        game.current_player = W;
+        s->finished = FALSE;
+      }
+      break;
+
+    case PLAY:
+      if(!(error = play(args, &current_move)))
+        end_move(s, response);
+      break;
+
+    case CONT:
+      if(!(error = cont(args, &current_move))) {
+        sprintf(response, "ok %s\n", (current_move.row == SWAP_MOVE) ? "swap" : move_str(current_move.row, current_move.col, move));
+        end_move(s, response);
+      }
+      break;
+
+    case SUGGEST: {
+      hex_limits limits = {0, MOVE_TIME_LIMIT, 1, engine->node_limit};
+      hex_result results[HEX_MAX_LINES];
+
+      if(args[1] && (args[2] || (limits.lines = parse_lines(args[1])) < 0))
+        error = INVALID_DIRECTIVE;
+      else if(game.current_player != game.user)
+        error = UNAVAILABLE_SUGGEST;
+      else if(!(error = hex_search(engine, &limits, &results[0]))) {
+        if(!args[1])
+          sprintf(response, "ok %s\n", results[0].move);
+        else { /* "ok", then each move's score and variation, separated by " | " */
+          int lines = hex_search_lines(engine, results), len = sprintf(response, "ok");
+
+          for(int k = 0; k < lines; k++) {
+            len += sprintf(response + len, "%s %s %s", k ? " |" : "", results[k].move, score_str(results[k].score, move));
+            for(int p = 0; p < results[k].pv_length; p++)
+              len += sprintf(response + len, " %s", move_str(results[k].pv[p].row, results[k].pv[p].col, move));
+          }
+          strcpy(response + len, "\n");
+        }
+      }
+      break;
+    }
+
+    case UNDO:
+      if(!(error = undo(args))) {
+        if(engine->history.swapped && !engine->history.ply) {
+          game.swap = ON;
+          game.current_player = W;
+        }
+        else
+          game.current_player = game.user;
+      }
+      break;
+
+    case LEVEL:
+      if(args[1]) {
+        int difficulty = atoi(args[1]);
+
+        for(int i = 0; args[1][i] != '\0'; i++)
+          if(!is_digit(args[1][i]))
+            error = INVALID_DIRECTIVE;
+        if(args[2])
+          error = INVALID_DIRECTIVE;
+        else if(!error && (difficulty < 1 || difficulty > game.dimension*game.dimension))
+          error = INVALID_DIFFICULTY;
+        else if(!error)
+          game.difficulty = difficulty;
+      }
+      if(!error)
+        sprintf(response, "ok %d\n", game.difficulty);
+      break;
+
+    case SWAP:
+      if(!(error = swap(args))) {
+        game.current_player ^= 1;
+      }
+      break;
+
+    case SHOWSTATE:
+    case SAVE:
+      if(args[1])
+        error = INVALID_DIRECTIVE;
+      else
+        write_state(response);
+      break;
+
+    case LOAD:
+      if(!(error = load_state(args)))
+        s->finished = FALSE;
+      break;
+
+    case QUIT:
+      s->closing = TRUE;
+      break;
+
+    default:
+      error = INVALID_DIRECTIVE;
+  }
+
+  if(error)
+    sprintf(response, "error %s\n", error_message(error));
+  engine = caller;
+}
+
+static void *worker(void *arg) {
+  char line[SESSION_INPUT], response[SESSION_OUTPUT];
+
+  while(TRUE) {
+    pthread_mutex_lock(&lock);
+    while(!queue_head)
+      pthread_cond_wait(&queued, &lock);
+
+    session_t *s = queue_head;
+    if(!(queue_head = s->next))
+      queue_tail = NULL;
+
+    /* Takes the first line out of the input buffer */
+    char *end = memchr(s->input, '\n', s->input_len);
+    size_t len = end - s->input;
+    memcpy(line, s->input, len);
+    line[len] = '\0';
+    s->input_len -= len+1;
+    memmove(s->input, end+1, s->input_len);
+    pthread_mutex_unlock(&lock);
+
+    execute(s, line, response);
+
+    pthread_mutex_lock(&lock);
+    respond(s, response);
+    if(!s->closing && !s->dead && memchr(s->input, '\n', s->input_len))
+      enqueue(s);
+    else
+      s->busy = FALSE;
+    pthread_mutex_unlock(&lock);
+
+    /* If the pipe is full, the poll loop is awake anyway */
+    if(write(wake[1], "", 1) < 0 && errno != EAGAIN)
+      perror("hexserver");
+  }
+
+  return arg;
+}
+
+static void open_session(int fd) {
+  session_t *s;
+
+  if(session_count == max_sessions) {
+    const char *full = "error The server is full\n";
+    send(fd, full, strlen(full), MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(fd);
+    return;
+  }
+
+  if(!(s = calloc(1, sizeof(session_t)))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  s->fd = fd;
+  if(!(s->engine = hex_create(11))) { /* The client is turned away, like when the server is full */
+    char error[SESSION_OUTPUT];
+    sprintf(error, "error %s\n", error_message(MEMALLOC_ERROR));
+    send(fd, error, strlen(error), MSG_NOSIGNAL | MSG_DONTWAIT);
+    close(fd);
+    free(s);
+    return;
+  }
+  hex_use_table(s->engine, table);
+  sessions[session_count++] = s;
+}
+
+static void close_session(int index) {
+  session_t *s = sessions[index];
+
+  close(s->fd);
+  hex_destroy(s->engine);
+  free(s);
+  sessions[index] = sessions[--session_count];
+}
+
+/* Reads what the client sent; a session with a complete line and no request running gets queued */
+static void read_session(session_t *s) {
+  ssize_t len = read(s->fd, s->input + s->input_len, SESSION_INPUT - s->input_len);
+
+  if(len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    s->dead = TRUE;
+    return;
+  }
+  if(len < 0)
+    return;
+
+  char *start = s->input + s->input_len;
+  if(s->overlong) { /* Skips the rest of a line that didn't fit */
+    char *end = memchr(start, '\n', len);
+    if(!end)
+      return;
+
+    s->overlong = FALSE;
+    len -= end+1 - start;
+    memmove(start, end+1, len);
+  }
+  s->input_len += len;
+
+  /* A line that fills the whole buffer is dropped, and answered like any invalid one */
+  if(s->input_len == SESSION_INPUT && !memchr(s->input, '\n', SESSION_INPUT)) {
+    memcpy(s->input, "?\n", 2);
+    s->input_len = 2;
+    s->overlong = TRUE;
+  }
+
+  if(!s->busy && memchr(s->input, '\n', s->input_len))
+    enqueue(s);
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  int threads = (argc > 2) ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int listener;
+
+  max_sessions = (argc > 3) ? atoi(argv[3]) : DEFAULT_SESSIONS;
+  if(argc < 2 || argc > 4 || threads < 1 || threads > MAX_THREADS || max_sessions < 1
+     || strlen(argv[1]) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Usage: %s <socket> [<threads> [<sessions>]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if(!engine_new() || !(table = hex_table_create(SERVER_TT_BITS))
+     || !(sessions = malloc(sizeof(session_t *) * max_sessions))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  strcpy(address.sun_path, argv[1]);
+  unlink(argv[1]);
+  if((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+     || bind(listener, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(listener, 128) < 0
+     || pipe(wake) < 0) {
+    perror("hexserver");
+    return EXIT_FAILURE;
+  }
+  fcntl(wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake[1], F_SETFL, O_NONBLOCK);
+  signal(SIGPIPE, SIG_IGN);
+
+  for(int t = 0; t < threads; t++) {
+    pthread_t thread;
+    int error;
+
+    if((error = pthread_create(&thread, NULL, worker, NULL))) {
+      fprintf(stderr, "hexserver: %s\n", strerror(error));
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("hexserver: listening on %s (%d threads, up to %d sessions)\n", argv[1], threads, max_sessions);
+  fflush(stdout);
+
+  struct pollfd *fds;
+  if(!(fds = malloc(sizeof(struct pollfd) * (max_sessions + 2)))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  while(TRUE) {
+    /* Rebuilds the poll set, closing finished sessions first */
+    pthread_mutex_lock(&lock);
+    for(int k = session_count-1; k >= 0; k--)
+      if(!sessions[k]->busy && (sessions[k]->dead || (sessions[k]->closing && !sessions[k]->output_len)))
+        close_session(k);
+
+    int count = session_count;
+    fds[0] = (struct pollfd) {listener, POLLIN, 0};
+    fds[1] = (struct pollfd) {wake[0], POLLIN, 0};
+    for(int k = 0; k < count; k++) {
+      session_t *s = sessions[k];
+      bool reading = !s->closing && !s->dead && s->input_len < SESSION_INPUT;
+      fds[k+2] = (struct pollfd) {s->fd, (reading ? POLLIN : 0) | (s->output_len ? POLLOUT : 0), 0};
+    }
+    pthread_mutex_unlock(&lock);
+
+    if(poll(fds, count+2, -1) < 0)
+      continue;
+
+    char drain[64];
+    while(read(wake[0], drain, sizeof(drain)) > 0);
+
+    pthread_mutex_lock(&lock);
+    for(int k = 0; k < count; k++) {
+      session_t *s = sessions[k];
+
+      if(fds[k+2].revents & POLLOUT)
+        respond(s, "");
+      if(fds[k+2].revents & POLLERR)
+        s->dead = TRUE;
+      else if((fds[k+2].events & POLLIN) && (fds[k+2].revents & (POLLIN | POLLHUP)))
+        read_session(s);
+    }
+    pthread_mutex_unlock(&lock);
+
+    if(fds[0].revents & POLLIN) {
+      int fd = accept(listener, NULL, NULL);
+      if(fd >= 0) {
+        pthread_mutex_lock(&lock);
+        open_session(fd);
+        pthread_mutex_unlock(&lock);
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
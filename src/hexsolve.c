@@ -0,0 +1,196 @@
+/* hexsolve: builds a solved-position database for small grids (load it with hex -S)
+ *
+ *   hexsolve <database> <size>:<stones> [<size>:<stones> ...]
+ *       solves every position of a <size> x <size> grid, reachable with White moving first,
+ *       that has at most <stones> stones and isn't already won
+ *
+ * Positions are stored once per symmetry class (see canonical_key()), and positions the
+ * solver can't settle within SOLVE_BUILD_LIMIT nodes are left out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "directives.h"
+#include "solver.h"
+
+#define SOLVE_BUILD_LIMIT 500000000
+
+/* The keys of the positions visited so far (an open-addressing set, 0 marks a free slot) */
+static uint64_t *seen;
+static size_t seen_size, seen_count;
+
+/* The entries of the table being built */
+static uint64_t *entries;
+static size_t entry_count, entry_size;
+
+static long unsolved, nodes;
+
+static void *grow(void *array, size_t size) {
+  if(!(array = realloc(array, size))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+  return array;
+}
+
+/* Adds <key> to the set, returning FALSE if it was already there */
+static bool insert(uint64_t key) {
+  if(2*(seen_count+1) > seen_size) {
+    uint64_t *old = seen;
+    size_t old_size = seen_size;
+
+    seen_size = seen_size ? 2*seen_size : 1 << 16;
+    seen = calloc(seen_size, sizeof(uint64_t));
+    if(!seen) {
+      print_error(MEMALLOC_ERROR);
+      exit(EXIT_FAILURE);
+    }
+    seen_count = 0;
+    for(size_t s = 0; s < old_size; s++)
+      if(old[s])
+        insert(old[s]);
+    free(old);
+  }
+
+  key |= !key; /* 0 marks a free slot */
+  size_t s = (key * 0x9E3779B97F4A7C15ULL) >> 20 & (seen_size-1);
+  while(seen[s]) {
+    if(seen[s] == key)
+      return FALSE;
+    s = (s+1) & (seen_size-1);
+  }
+
+  seen[s] = key;
+  seen_count++;
+  return TRUE;
+}
+
+/* Solves the current position and everything reachable from it with at most <stones> more stones */
+static void visit(int stones) {
+  int transform;
+  uint64_t key = canonical_key(TRUE, &transform);
+
+  if(!insert(key))
+    return;
+
+  Colour last = !game.current_player;
+  if(game_finished(!PRINT_PATH, last))
+    return;
+
+  bitboard_t bb;
+  int cell;
+  long count;
+
+  to_bitboard(&bb);
+  int result = solve(&bb, game.current_player, SOLVE_BUILD_LIMIT, &cell, &count);
+  if(result == SOLVE_NO_MEMORY) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+  nodes += count;
+
+  if(result < 0 || cell < 0)
+    unsolved++;
+  else {
+    int row = cell / 8, col = cell % 8;
+    transform_cell(transform, &row, &col);
+
+    if(entry_count == entry_size) {
+      entry_size = entry_size ? 2*entry_size : 1 << 16;
+      entries = grow(entries, entry_size * sizeof(uint64_t));
+    }
+    entries[entry_count++] = (key & ~0xFFFFULL) | (result ? SD_WIN : 0) | (row*MAX_DIMENSION + col);
+  }
+
+  if(!stones)
+    return;
+
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++) {
+      if(game.grid[i][j] != ' ')
+        continue;
+
+      set_hex(i, j, (game.current_player == W) ? 'w' : 'b');
+      game.current_player = !game.current_player;
+      visit(stones-1);
+      game.current_player = !game.current_player;
+      set_hex(i, j, ' ');
+    }
+}
+
+static int compare(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  sd_header header = {SD_MAGIC, SD_VERSION, argc-2, 0};
+  sd_table tables[SD_MAX_TABLES];
+  int dimensions[SD_MAX_TABLES], stones[SD_MAX_TABLES];
+  FILE *file;
+
+  if(!engine_new()) {
+    print_error(MEMALLOC_ERROR);
+    return EXIT_FAILURE;
+  }
+
+  if(argc < 3 || argc-2 > SD_MAX_TABLES) {
+    fprintf(stderr, "Usage: %s <database> <size>:<stones> [<size>:<stones> ...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  for(int t = 0; t < argc-2; t++)
+    if(sscanf(argv[t+2], "%d:%d", &dimensions[t], &stones[t]) != 2 || dimensions[t] < MIN_DIMENSION
+       || dimensions[t] > SOLVER_MAX_DIMENSION || stones[t] < 0 || stones[t] > dimensions[t]*dimensions[t]) {
+      fprintf(stderr, "hexsolve: invalid table %s (sizes go up to %d)\n", argv[t+2], SOLVER_MAX_DIMENSION);
+      return EXIT_FAILURE;
+    }
+
+  if(!(file = fopen(argv[1], "wb"))) {
+    fprintf(stderr, "hexsolve: %s cannot be opened\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  /* The header and the table directory are written last, once the offsets are known */
+  uint64_t offset = sizeof(header) + header.table_count*sizeof(sd_table);
+  fseek(file, offset, SEEK_SET);
+
+  for(int t = 0; t < argc-2; t++) {
+    double start = wall_time();
+
+    game.dimension = dimensions[t];
+    game.current_player = W;
+    if(!init_grid()) {
+      print_error(MEMALLOC_ERROR);
+      exit(EXIT_FAILURE);
+    }
+
+    seen_count = entry_count = 0;
+    memset(seen, 0, seen_size * sizeof(uint64_t));
+    unsolved = nodes = 0;
+
+    visit(stones[t]);
+    qsort(entries, entry_count, sizeof(uint64_t), compare);
+
+    tables[t] = (sd_table) {dimensions[t], 0, entry_count, offset};
+    fwrite(entries, sizeof(uint64_t), entry_count, file);
+    offset += entry_count * sizeof(uint64_t);
+
+    free_grid(game.grid);
+    printf("%dx%d: %zu positions solved, %ld left out, %ld nodes in %.2fs\n",
+           dimensions[t], dimensions[t], entry_count, unsolved, nodes, wall_time() - start);
+  }
+
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(tables, sizeof(sd_table), header.table_count, file);
+  fclose(file);
+
+  free(seen);
+  free(entries);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,330 @@
+/* hextune: fits the evaluator's feature weights to labelled positions (Texel-style tuning)
+ *
+ *   hextune generate <positions> <size> <games>
+ *       plays random games and writes every position, labelled with the game's result
+ *   hextune tune <positions> <weights> [<threads>]
+ *       fits the weights by logistic regression and writes them to <weights> (load them with hex -e)
+ *
+ * The predicted probability that White wins a position is sigmoid(sum of weight * feature),
+ * so the fitted weights are in logit units. The fit minimises the cross-entropy (plus a tiny
+ * ridge term) with Newton's method; each iteration's gradient and Hessian are accumulated
+ * over the memory-mapped position file by <threads> threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "directives.h"
+#include "evaluate.h"
+#include "positions.h"
+
+#define MAX_THREADS 256
+#define MAX_ITERATIONS 50
+#define RIDGE 1e-6 /* Keeps the Hessian invertible when a feature is constant */
+#define CONVERGED 1e-9 /* The fit stops when the loss improves by less than this */
+
+typedef struct worker_t {
+  pthread_t thread;
+  const float *features; /* FEATURE_COUNT floats per position */
+  const int8_t *results;
+  size_t first, last; /* The range of positions handled by this worker */
+  const double *weights;
+
+  double loss, gradient[FEATURE_COUNT], hessian[FEATURE_COUNT][FEATURE_COUNT];
+} worker_t;
+
+static uint64_t rng_state = 0x68657874756E65ULL;
+
+static uint64_t next_random(void) {
+  uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* Plays <games> random games, writing every position before the winning move */
+static int generate(char *filename, int dimension, long games) {
+  int cells = dimension*dimension;
+  int order[MAX_CELLS];
+  uint8_t *records;
+  FILE *file;
+
+  if(dimension < MIN_DIMENSION || dimension > MAX_DIMENSION || games < 1) {
+    fprintf(stderr, "hextune: invalid size or game count\n");
+    return EXIT_FAILURE;
+  }
+  if(!(file = pos_create(filename, dimension))) {
+    fprintf(stderr, "hextune: %s cannot be opened\n", filename);
+    return EXIT_FAILURE;
+  }
+  if(!(records = malloc(pos_record_size(dimension) * cells))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  game.dimension = dimension;
+  if(!init_grid()) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  long positions = 0;
+  double start = wall_time();
+
+  for(long g = 0; g < games; g++) {
+    empty_grid();
+
+    /* A random permutation of the cells gives the game's move order */
+    for(int c = 0; c < cells; c++)
+      order[c] = c;
+    for(int c = cells-1; c > 0; c--) {
+      int k = next_random() % (c+1);
+      int temp = order[c]; order[c] = order[k]; order[k] = temp;
+    }
+
+    /* Each position is packed before its move is played; the results are filled in at the end */
+    int ply;
+    Colour player = W;
+    for(ply = 0; ply < cells; ply++, player ^= 1) {
+      pos_pack(records + ply*pos_record_size(dimension), 0, 0, order[ply]);
+      set_hex(order[ply] / dimension, order[ply] % dimension, (player == W) ? 'w' : 'b');
+
+      /* Neither player can have connected their sides before their dimension-th stone */
+      if(ply >= 2*dimension-2 && game_finished(!PRINT_PATH, player))
+        break;
+    }
+
+    for(int p = 0; p <= ply; p++)
+      records[p*pos_record_size(dimension)] = (uint8_t) (int8_t) ((player == W) ? 1 : -1);
+
+    fwrite(records, pos_record_size(dimension), ply+1, file);
+    positions += ply+1;
+  }
+
+  fclose(file);
+  free(records);
+  free_grid(game.grid);
+
+  printf("%s: %ld games, %ld positions (%.0f games/sec)\n", filename, games, positions, games / (wall_time() - start));
+  return EXIT_SUCCESS;
+}
+
+/* Accumulates the cross-entropy, its gradient and its Hessian over a worker's positions */
+static void *accumulate(void *arg) {
+  worker_t *worker = arg;
+
+  worker->loss = 0.0;
+  memset(worker->gradient, 0, sizeof(worker->gradient));
+  memset(worker->hessian, 0, sizeof(worker->hessian));
+
+  for(size_t p = worker->first; p < worker->last; p++) {
+    const float *f = worker->features + p*FEATURE_COUNT;
+    double z = 0.0, y = (worker->results[p] > 0);
+
+    for(int k = 0; k < FEATURE_COUNT; k++)
+      z += worker->weights[k] * f[k];
+
+    double prob = 1.0 / (1.0 + exp(-z));
+    worker->loss -= (y > 0.5) ? log(prob + 1e-15) : log(1.0 - prob + 1e-15);
+
+    double error = prob - y, curvature = prob * (1.0 - prob);
+    for(int k = 0; k < FEATURE_COUNT; k++) {
+      worker->gradient[k] += error * f[k];
+      for(int l = 0; l <= k; l++)
+        worker->hessian[k][l] += curvature * f[k] * f[l];
+    }
+  }
+
+  return NULL;
+}
+
+/* Solves a*x = b (Gaussian elimination with partial pivoting), returning FALSE if a is singular */
+static bool solve(double a[FEATURE_COUNT][FEATURE_COUNT], double *b, double *x) {
+  for(int col = 0; col < FEATURE_COUNT; col++) {
+    int pivot = col;
+    for(int row = col+1; row < FEATURE_COUNT; row++)
+      if(fabs(a[row][col]) > fabs(a[pivot][col]))
+        pivot = row;
+    if(fabs(a[pivot][col]) < 1e-300)
+      return FALSE;
+
+    for(int k = 0; k < FEATURE_COUNT; k++) {
+      double temp = a[col][k]; a[col][k] = a[pivot][k]; a[pivot][k] = temp;
+    }
+    double temp = b[col]; b[col] = b[pivot]; b[pivot] = temp;
+
+    for(int row = col+1; row < FEATURE_COUNT; row++) {
+      double factor = a[row][col] / a[col][col];
+      for(int k = col; k < FEATURE_COUNT; k++)
+        a[row][k] -= factor * a[col][k];
+      b[row] -= factor * b[col];
+    }
+  }
+
+  for(int row = FEATURE_COUNT-1; row >= 0; row--) {
+    x[row] = b[row];
+    for(int k = row+1; k < FEATURE_COUNT; k++)
+      x[row] -= a[row][k] * x[k];
+    x[row] /= a[row][row];
+  }
+
+  return TRUE;
+}
+
+static int tune(char *positions_name, char *weights_name, int thread_count) {
+  pos_file positions;
+  float *features;
+  int8_t *results;
+
+  if(thread_count < 1 || thread_count > MAX_THREADS) {
+    fprintf(stderr, "hextune: invalid thread count\n");
+    return EXIT_FAILURE;
+  }
+  if(!pos_open(&positions, positions_name)) {
+    fprintf(stderr, "hextune: %s is not a valid position file\n", positions_name);
+    return EXIT_FAILURE;
+  }
+  if(!(features = malloc(sizeof(float) * FEATURE_COUNT * positions.count))
+     || !(results = malloc(positions.count))) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  game.dimension = positions.dimension;
+  if(!init_grid()) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+
+  char **batch[DISTANCE_LANES];
+  int batch_count = 0;
+  for(int b = 0; b < DISTANCE_LANES; b++)
+    if(!(batch[b] = alloc_grid(game.dimension))) {
+      print_error(MEMALLOC_ERROR);
+      exit(EXIT_FAILURE);
+    }
+
+  /* The features are extracted once, a batch of positions at a time; positions that are */
+  /* already won are skipped, since static_evaluate() never asks the weights about them */
+  double start = wall_time();
+  size_t count = 0;
+  for(size_t p = 0; p < positions.count; p++) {
+    const uint8_t *record = positions.records + p*positions.record_size;
+
+    pos_unpack(record);
+    if(!game_finished(!PRINT_PATH, W) && !game_finished(!PRINT_PATH, B)) {
+      copy_grid(batch[batch_count], game.grid, game.dimension);
+      results[count + batch_count++] = (int8_t) record[0];
+    }
+
+    if(batch_count == DISTANCE_LANES || (p == positions.count-1 && batch_count)) {
+      double f[DISTANCE_LANES][FEATURE_COUNT];
+
+      compute_features_batch(batch_count, batch, &f[0][0]);
+      for(int b = 0; b < batch_count; b++, count++)
+        for(int k = 0; k < FEATURE_COUNT; k++)
+          features[count*FEATURE_COUNT + k] = f[b][k];
+      batch_count = 0;
+    }
+  }
+
+  for(int b = 0; b < DISTANCE_LANES; b++)
+    free_grid(batch[b]);
+  pos_close(&positions);
+  free_grid(game.grid);
+  printf("%zu positions (%zu undecided), features extracted in %.2fs\n",
+         positions.count, count, wall_time() - start);
+
+  if(!count) {
+    fprintf(stderr, "hextune: no positions to fit\n");
+    return EXIT_FAILURE;
+  }
+
+  worker_t workers[MAX_THREADS];
+  double weights[FEATURE_COUNT] = {0.0}, last_loss = INFINITY;
+
+  int iteration;
+  start = wall_time();
+  for(iteration = 1; iteration <= MAX_ITERATIONS; iteration++) {
+    for(int t = 0; t < thread_count; t++) {
+      workers[t].features = features;
+      workers[t].results = results;
+      workers[t].first = count * t / thread_count;
+      workers[t].last = count * (t+1) / thread_count;
+      workers[t].weights = weights;
+      pthread_create(&workers[t].thread, NULL, accumulate, &workers[t]);
+    }
+
+    double loss = 0.0, gradient[FEATURE_COUNT] = {0.0}, hessian[FEATURE_COUNT][FEATURE_COUNT] = {{0.0}};
+    for(int t = 0; t < thread_count; t++) {
+      pthread_join(workers[t].thread, NULL);
+
+      loss += workers[t].loss;
+      for(int k = 0; k < FEATURE_COUNT; k++) {
+        gradient[k] += workers[t].gradient[k];
+        for(int l = 0; l <= k; l++)
+          hessian[k][l] += workers[t].hessian[k][l];
+      }
+    }
+
+    loss /= count;
+    for(int k = 0; k < FEATURE_COUNT; k++) {
+      loss += RIDGE/2 * weights[k] * weights[k];
+      gradient[k] = gradient[k]/count + RIDGE * weights[k];
+      for(int l = 0; l <= k; l++)
+        hessian[l][k] = hessian[k][l] = hessian[k][l]/count + ((k == l) ? RIDGE : 0.0);
+    }
+
+    printf("iteration %2d: loss %.6f\n", iteration, loss);
+    if(last_loss - loss < CONVERGED)
+      break;
+    last_loss = loss;
+
+    double step[FEATURE_COUNT];
+    if(!solve(hessian, gradient, step))
+      break;
+    for(int k = 0; k < FEATURE_COUNT; k++)
+      weights[k] -= step[k];
+  }
+
+  iteration = (iteration > MAX_ITERATIONS) ? MAX_ITERATIONS : iteration;
+  double elapsed = wall_time() - start;
+  printf("fitted in %.2fs, %d iterations with %d threads (%.0f positions/sec)\n",
+         elapsed, iteration, thread_count, count * iteration / elapsed);
+
+  for(int k = 0; k < FEATURE_COUNT; k++)
+    printf("%s %.9g\n", feature_names[k], weights[k]);
+
+  free(features);
+  free(results);
+
+  if(save_weights(weights_name, weights)) {
+    fprintf(stderr, "hextune: %s cannot be opened\n", weights_name);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+  if(!engine_new()) {
+    print_error(MEMALLOC_ERROR);
+    return EXIT_FAILURE;
+  }
+
+  if(argc == 5 && !strcmp(argv[1], "generate"))
+    return generate(argv[2], atoi(argv[3]), atol(argv[4]));
+
+  if((argc == 4 || argc == 5) && !strcmp(argv[1], "tune"))
+    return tune(argv[2], argv[3], (argc == 5) ? atoi(argv[4]) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+
+  fprintf(stderr, "Usage: %s generate <positions> <size> <games>\n", argv[0]);
+  fprintf(stderr, "       %s tune <positions> <weights> [<threads>]\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "history.h"
+#include "directives.h"
+
+/* Frees the snapshots from the <k>-th on */
+static void drop_snapshots(int k) {
+  history_t *h = &engine->history;
+
+  while(h->snapshot_count > k)
+    free(h->snapshots[--h->snapshot_count].pattern);
+}
+
+void history_clear(void) {
+  drop_snapshots(0);
+  engine->history.ply = engine->history.length = 0;
+  engine->history.swapped = FALSE;
+}
+
+void history_free(void) {
+  history_clear();
+  free(engine->history.moves);
+  free(engine->history.snapshots);
+  memset(&engine->history, 0, sizeof(history_t));
+}
+
+/* Snapshots the grid's position, which is at ply snapshot_count*SNAPSHOT_INTERVAL (FALSE if */
+/* there's no memory for it) */
+static bool take_snapshot(void) {
+  history_t *h = &engine->history;
+  int n = game.dimension;
+  size_t patterns = n*n * sizeof(unsigned short), cells = STRIDE(n)*STRIDE(n);
+
+  if(h->snapshot_count == h->snapshot_size) {
+    int size = h->snapshot_size ? 2*h->snapshot_size : 8;
+    snapshot *snapshots = realloc(h->snapshots, size * sizeof(snapshot));
+
+    if(!snapshots)
+      return FALSE;
+    h->snapshots = snapshots;
+    h->snapshot_size = size;
+  }
+
+  snapshot *s = &h->snapshots[h->snapshot_count];
+  if(!(s->pattern = malloc(patterns + cells)))
+    return FALSE;
+
+  h->snapshot_count++;
+  s->player = game.current_player;
+  memcpy(s->hash, game.hash, sizeof(game.hash));
+  s->cells = (char *) s->pattern + patterns;
+  memcpy(s->pattern, game.pattern, patterns);
+  memcpy(s->cells, game.cells, cells);
+  return TRUE;
+}
+
+static void restore_snapshot(int k) {
+  history_t *h = &engine->history;
+  snapshot *s = &h->snapshots[k];
+  int n = game.dimension;
+
+  game.current_player = s->player;
+  memcpy(game.hash, s->hash, sizeof(game.hash));
+  memcpy(game.pattern, s->pattern, n*n * sizeof(unsigned short));
+  memcpy(game.cells, s->cells, STRIDE(n)*STRIDE(n));
+  h->ply = k*SNAPSHOT_INTERVAL;
+}
+
+/* The moves past the current ply are only dropped once there's room for the new one (and its */
+/* snapshot, if one is due): a failure leaves the history as it was */
+bool history_push(int row, int col) {
+  history_t *h = &engine->history;
+
+  if(h->ply == h->size) {
+    int size = h->size ? 2*h->size : 64;
+    Move *moves = realloc(h->moves, size * sizeof(Move));
+
+    if(!moves)
+      return FALSE;
+    h->moves = moves;
+    h->size = size;
+  }
+
+  /* A snapshot is due if there's none at this ply (truncating only drops later ones) */
+  if(h->ply == h->snapshot_count*SNAPSHOT_INTERVAL && !take_snapshot())
+    return FALSE;
+  history_truncate();
+
+  h->moves[h->ply++] = (Move) {row, col, game.current_player};
+  h->length = h->ply;
+  return TRUE;
+}
+
+/* Restores the nearest snapshot, if that leaves fewer moves to place or remove than going */
+/* there from the current ply */
+void history_goto(int ply) {
+  history_t *h = &engine->history;
+  int k = min(ply / SNAPSHOT_INTERVAL, h->snapshot_count - 1);
+
+  if(k >= 0 && ply - k*SNAPSHOT_INTERVAL < abs(ply - h->ply))
+    restore_snapshot(k);
+
+  while(h->ply > ply) {
+    Move *move = &h->moves[--h->ply];
+
+    set_hex(move->row, move->col, ' ');
+    game.current_player = move->player_clr;
+  }
+
+  while(h->ply < ply) {
+    Move *move = &h->moves[h->ply++];
+
+    set_hex(move->row, move->col, (move->player_clr == W) ? 'w' : 'b');
+    game.current_player = !move->player_clr;
+  }
+}
+
+/* A snapshot at the current ply stays (it's the position on the grid) */
+void history_truncate(void) {
+  history_t *h = &engine->history;
+
+  h->length = h->ply;
+  drop_snapshots(h->ply / SNAPSHOT_INTERVAL + 1);
+}
+
+/* Makes the first move <player>'s: its stone is replaced by the symmetric one, in their colour */
+void swap_first_move(Colour player) {
+  Move *first_move = &engine->history.moves[0];
+
+  /* The moves that followed the first one (if the game was gone back to it) no longer apply */
+  history_truncate();
+
+  /* Play the symmetric move for player */
+  set_hex(first_move->row, first_move->col, ' ');
+  set_hex(first_move->col, first_move->row, (player == W) ? 'w' : 'b');
+
+  /* swap the first move's row and col values and update its player_clr */
+  XORSWAP(first_move->row, first_move->col);
+  first_move->player_clr = player;
+
+  game.swap = OFF;
+  engine->history.swapped = TRUE;
+}
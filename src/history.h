@@ -0,0 +1,19 @@
+/* Game history: the moves played, kept in an array, with a snapshot of the position every
+ * SNAPSHOT_INTERVAL plies. Any ply is reached by restoring the last snapshot at or before it and
+ * replaying fewer than SNAPSHOT_INTERVAL moves, or by placing or removing the stones in between
+ * when there are fewer of them. A snapshot holds everything set_hex() keeps up to date (the
+ * cells, Zobrist keys and patterns), so a position that's jumped to is exactly the one that was
+ * left, and the transposition table's and the caches' entries for it are found again.
+ *
+ * The moves past the current ply (after going back) are kept, so they can be replayed, until
+ * another move is played there.
+ */
+
+#define SNAPSHOT_INTERVAL 16
+
+void history_clear(void); /* Forgets the current engine's moves (and swap): the grid's position becomes ply 0 */
+void history_free(void); /* Frees the current engine's history */
+bool history_push(int, int); /* Records a move of the player to move, before it's placed (FALSE if there's no memory) */
+void history_goto(int); /* Moves the grid (and the player to move) to a ply of the history */
+void history_truncate(void); /* Forgets the moves past the current ply */
+void swap_first_move(Colour); /* Makes the first move the given player's, recording that the swap was used */
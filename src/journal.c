@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "history.h"
+#include "directives.h"
+#include "journal.h"
+
+static struct {
+  char *filename;
+  int fd;
+  bool running, stop;
+  bool failed; /* A write failed (or a record was lost): written by both threads, atomically */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+
+  jl_record *pending; /* Records appended since the writer's last batch */
+  int pending_count, pending_size;
+  uint32_t records; /* Records in the journal, once the pending ones are written */
+
+  jl_record *recovered; /* The session read by journal_open(), until journal_start() replays it */
+  int recovered_count;
+} journal = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+/* FNV-1a of a record's fields and its position in the journal */
+static uint32_t checksum(const jl_record *record, uint32_t index) {
+  uint8_t bytes[12];
+  uint32_t hash = 2166136261u;
+
+  memcpy(bytes, record, 8);
+  memcpy(bytes + 8, &index, 4);
+  for(int i = 0; i < 12; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+bool journal_open(char *filename) {
+  jl_header header;
+  jl_record record;
+  FILE *file;
+  int first = 0;
+
+  journal.filename = filename;
+  if(!(file = fopen(filename, "rb")))
+    return TRUE; /* A new journal */
+
+  /* An empty file is a journal whose header was never written; anything else must be one */
+  size_t got = fread(&header, 1, sizeof(header), file);
+  if(got && (got != sizeof(header) || memcmp(header.magic, JL_MAGIC, 4) || header.version != JL_VERSION)) {
+    fclose(file);
+    return FALSE;
+  }
+
+  /* The session starts at the last new game, and ends at the first record that doesn't check */
+  for(uint32_t k = 0; fread(&record, sizeof(record), 1, file) == 1 && record.check == checksum(&record, k); k++) {
+    if(record.type == JL_GAME)
+      first = journal.recovered_count;
+
+    jl_record *grown = realloc(journal.recovered, (journal.recovered_count+1) * sizeof(jl_record));
+    if(!grown) {
+      fclose(file);
+      return FALSE;
+    }
+    journal.recovered = grown;
+    journal.recovered[journal.recovered_count++] = record;
+  }
+  fclose(file);
+
+  memmove(journal.recovered, journal.recovered + first, (journal.recovered_count - first) * sizeof(jl_record));
+  journal.recovered_count -= first;
+  return TRUE;
+}
+
+/* Replays a record onto the game, returning FALSE if it can't apply (the journal ends there) */
+static bool apply(const jl_record *record) {
+  history_t *h = &engine->history;
+  int n = game.dimension, a = record->a, b = record->b;
+  Colour player = record->player;
+
+  if(record->player > W)
+    return FALSE;
+
+  switch(record->type) {
+    case JL_GAME:
+      if(a < MIN_DIMENSION || a > MAX_DIMENSION || b < 1 || b > a*a)
+        return FALSE;
+
+      if(!resize_grid(a)) /* The same as load's change of size */
+        return FALSE;
+
+      history_clear();
+      game.difficulty = b;
+      game.user = player;
+      game.swap = record->flag ? ON : OFF;
+      game.current_player = W;
+      return TRUE;
+
+    case JL_LEVEL:
+      if(a > LEVELS)
+        return FALSE;
+      game.level = a;
+      return TRUE;
+
+    case JL_STONE:
+    case JL_MOVE:
+      if(a >= n || b >= n || game.grid[a][b] != ' ')
+        return FALSE;
+
+      if(record->type == JL_STONE)
+        set_hex(a, b, (player == W) ? 'w' : 'b');
+      else {
+        game.current_player = player;
+        if(!play_move(a, b))
+          return FALSE;
+        game.current_player = !player;
+      }
+      return TRUE;
+
+    case JL_SWAP:
+      if(h->ply != 1)
+        return FALSE;
+      swap_first_move(player);
+      game.current_player = !player;
+      return TRUE;
+
+    case JL_GOTO:
+      if(a > h->length)
+        return FALSE;
+      history_goto(a);
+      if(record->flag)
+        history_truncate();
+      return TRUE;
+
+    case JL_TURN:
+      game.current_player = player;
+      game.swap = record->flag ? ON : OFF;
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Syncs the directory that holds the journal, so that a rename() within it is on disk too */
+static bool sync_directory(void) {
+  char *slash = strrchr(journal.filename, '/'), *directory;
+  int fd;
+
+  if(!slash)
+    directory = strdup(".");
+  else if((directory = strdup(journal.filename)))
+    directory[(slash == journal.filename) ? 1 : slash - journal.filename] = '\0';
+  if(!directory)
+    return FALSE;
+
+  fd = open(directory, O_RDONLY | O_DIRECTORY);
+  free(directory);
+  if(fd < 0)
+    return FALSE;
+
+  bool synced = !fsync(fd);
+  close(fd);
+  return synced;
+}
+
+/* Writes the journal anew (the header, then <count> records) through a temporary file, which */
+/* replaces it once it's on disk, and opens it for appending */
+static bool rewrite(jl_record *records, int count) {
+  jl_header header = {JL_MAGIC, JL_VERSION, {0}};
+  char *temporary = malloc(strlen(journal.filename) + sizeof(".tmp"));
+  FILE *file;
+
+  if(!temporary)
+    return FALSE;
+  sprintf(temporary, "%s.tmp", journal.filename);
+  if(!(file = fopen(temporary, "wb"))) {
+    free(temporary);
+    return FALSE;
+  }
+
+  for(int k = 0; k < count; k++)
+    records[k].check = checksum(&records[k], k);
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1
+                 && fwrite(records, sizeof(jl_record), count, file) == (size_t) count
+                 && !fflush(file) && !fsync(fileno(file));
+  written = !fclose(file) && written && !rename(temporary, journal.filename) && sync_directory();
+  free(temporary);
+  if(!written)
+    return FALSE;
+
+  journal.records = count;
+  return (journal.fd = open(journal.filename, O_WRONLY | O_APPEND)) >= 0;
+}
+
+/* The writer thread: writes and syncs the pending records a batch at a time */
+static void *write_batches(void *arg) {
+  jl_record *batch = NULL;
+  int batch_size = 0;
+
+  pthread_mutex_lock(&journal.lock);
+  while(TRUE) {
+    while(!journal.pending_count && !journal.stop)
+      pthread_cond_wait(&journal.wake, &journal.lock);
+    if(!journal.pending_count)
+      break;
+
+    /* The buffers are swapped, so that records can be appended while the batch is written */
+    jl_record *records = journal.pending;
+    int count = journal.pending_count, size = journal.pending_size;
+
+    journal.pending = batch;
+    journal.pending_size = batch_size;
+    journal.pending_count = 0;
+    batch = records;
+    batch_size = size;
+    pthread_mutex_unlock(&journal.lock);
+
+    if(!__atomic_load_n(&journal.failed, __ATOMIC_RELAXED)
+       && (write(journal.fd, batch, count * sizeof(jl_record)) != (ssize_t) (count * sizeof(jl_record))
+           || fdatasync(journal.fd))
+       && !__atomic_exchange_n(&journal.failed, TRUE, __ATOMIC_RELAXED))
+      print_error(JOURNAL_ERROR); /* The session goes on without its journal */
+
+    pthread_mutex_lock(&journal.lock);
+  }
+  pthread_mutex_unlock(&journal.lock);
+
+  free(batch);
+  return arg;
+}
+
+bool journal_start(void) {
+  int count = 0;
+
+  if(!journal.filename)
+    return TRUE;
+
+  while(count < journal.recovered_count && apply(&journal.recovered[count]))
+    count++;
+
+  /* A finished game isn't resumed: the session goes on with a new one */
+  if(game_finished(!PRINT_PATH, B) || game_finished(!PRINT_PATH, W)) {
+    empty_grid();
+    history_clear();
+    game.current_player = W;
+    count = 0;
+  }
+  else if(count && !engine->quiet)
+    printf("Session recovered from %s (move %d)\n", journal.filename, engine->history.ply);
+
+  bool rewritten = rewrite(journal.recovered, count);
+  free(journal.recovered);
+  journal.recovered = NULL;
+
+  if(!rewritten)
+    return FALSE;
+  if(pthread_create(&journal.thread, NULL, write_batches, NULL)) {
+    close(journal.fd);
+    return FALSE;
+  }
+  journal.running = TRUE;
+
+  if(!count)
+    journal_game();
+  return TRUE;
+}
+
+void journal_close(void) {
+  if(!journal.running)
+    return;
+
+  pthread_mutex_lock(&journal.lock);
+  journal.stop = TRUE;
+  pthread_cond_signal(&journal.wake);
+  pthread_mutex_unlock(&journal.lock);
+
+  pthread_join(journal.thread, NULL);
+  close(journal.fd);
+  free(journal.pending);
+  journal.running = FALSE;
+}
+
+void journal_append(int type, Colour player, int flag, int a, int b) {
+  jl_record record = {type, player, flag, 0, a, b, 0};
+
+  if(!journal.running)
+    return;
+
+  pthread_mutex_lock(&journal.lock);
+  record.check = checksum(&record, journal.records++);
+  if(journal.pending_count == journal.pending_size) {
+    int size = journal.pending_size ? 2*journal.pending_size : JL_BATCH;
+    jl_record *grown = realloc(journal.pending, size * sizeof(jl_record));
+
+    /* Without the memory to buffer it, the record is lost: the session goes on without its journal */
+    if(!grown) {
+      if(!__atomic_exchange_n(&journal.failed, TRUE, __ATOMIC_RELAXED))
+        print_error(JOURNAL_ERROR);
+      pthread_mutex_unlock(&journal.lock);
+      return;
+    }
+    journal.pending = grown;
+    journal.pending_size = size;
+  }
+  journal.pending[journal.pending_count++] = record;
+  pthread_cond_signal(&journal.wake);
+  pthread_mutex_unlock(&journal.lock);
+}
+
+void journal_game(void) {
+  journal_append(JL_GAME, game.user, game.swap == ON, game.dimension, game.difficulty);
+  journal_append(JL_LEVEL, B, 0, game.level, 0);
+}
+
+static void journal_turn(void) {
+  journal_append(JL_TURN, game.current_player, game.swap == ON, 0, 0);
+}
+
+void journal_position(void) {
+  journal_game();
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++)
+      if(game.grid[i][j] != ' ')
+        journal_append(JL_STONE, (game.grid[i][j] == 'w') ? W : B, 0, i, j);
+  journal_turn();
+}
+
+void journal_goto(bool truncated) {
+  journal_append(JL_GOTO, B, truncated, engine->history.ply, 0);
+  journal_turn();
+}
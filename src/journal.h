@@ -0,0 +1,52 @@
+/* Session journal: an append-only file of the interactive game's moves and settings changes,
+ * from which a session that crashed (or was killed) is recovered when the program is started
+ * again with the same journal (-j). The file holds:
+ *   jl_header
+ *   jl_records, the game's events in order, each protected by a checksum of its fields and
+ *   its position in the file, so that a torn or stale record ends the journal there
+ *
+ * Records are appended to a buffer, from which a thread of the journal's own writes them,
+ * syncing each batch (every record that arrived while the previous batch was synced) with one
+ * fdatasync: a directive never waits for the disk, and a crash loses at most the last batch.
+ * On recovery, the records before the last new game are dropped and the journal is rewritten.
+ */
+
+#define JL_MAGIC "HXJL"
+#define JL_VERSION 1
+#define JL_BATCH 256 /* Records the buffer starts with (it grows if the disk falls behind) */
+
+typedef struct jl_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t reserved[2];
+} jl_header;
+
+typedef struct jl_record {
+  uint8_t type;
+  uint8_t player; /* A colour */
+  uint8_t flag;
+  uint8_t reserved;
+  uint16_t a, b;
+  uint32_t check;
+} jl_record;
+
+/* Record types */
+#define JL_GAME  1 /* A new game: a = dimension, b = difficulty, player = user, flag = swap rule */
+#define JL_LEVEL 2 /* The difficulty ladder's level (a), which follows every JL_GAME */
+#define JL_STONE 3 /* A stone placed outside the history (by load): a = row, b = col, player */
+#define JL_MOVE  4 /* A move: a = row, b = col, player */
+#define JL_SWAP  5 /* The first move was swapped by player */
+#define JL_GOTO  6 /* The history went to ply a, dropping the moves past it if flag is set */
+#define JL_TURN  7 /* The player to move (player), and the swap rule (flag) */
+
+bool journal_open(char *); /* Opens (or creates) a journal, reading the session it holds */
+/* Replays the journal's session onto the game, then starts journaling it. Returns FALSE */
+/* if the journal can't be rewritten or its writer can't be started */
+bool journal_start(void);
+void journal_close(void); /* Writes the records still buffered and closes the journal */
+
+/* The following functions do nothing unless a journal is open */
+void journal_append(int, Colour, int, int, int); /* Appends a record: type, player, flag, a, b */
+void journal_game(void); /* Appends a new game, with the current settings */
+void journal_position(void); /* Appends a new game holding the grid's stones (a loaded position) */
+void journal_goto(bool); /* Appends a move to the history's current ply (truncating it, or not), and the turn */
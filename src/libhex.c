@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "libhex.h"
+#include "directives.h"
+#include "grid.h"
+#include "ttable.h"
+#include "history.h"
+
+_Thread_local engine_t *engine = NULL;
+
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+/* The library's errors are the game's error indices (directives.h), which the programs print */
+_Static_assert(HEX_INVALID_MOVE == INVALID_MOVE && HEX_OCCUPIED_POSITION == OCCUPIED_POSITION
+               && HEX_INVALID_ARGUMENT == INVALID_DIRECTIVE && HEX_EMPTY_MOVE_LIST == EMPTY_MOVE_LIST
+               && HEX_MEMALLOC_ERROR == MEMALLOC_ERROR && HEX_GAME_OVER == GAME_OVER
+               && HEX_SEARCH_IN_PROGRESS == SEARCH_IN_PROGRESS, "libhex.h's errors differ from directives.h's");
+
+/* Each entry point works on the engine it's given as the current one, and restores the */
+/* caller's current engine when it returns */
+static void restore_engine(engine_t **caller) {
+  engine = *caller;
+}
+
+#define KEEP_CALLER_ENGINE engine_t *caller __attribute__((cleanup(restore_engine))) = engine
+
+/* Allocates an engine with the default settings (but no grid yet) and makes it the */
+/* calling thread's current engine; returns NULL (leaving the current engine as it was) if */
+/* there's no memory for it */
+engine_t *engine_new(void) {
+  engine_t *e;
+
+  pthread_once(&tables_once, init_tables);
+
+  if(!(e = calloc(1, sizeof(engine_t))))
+    return NULL;
+  if(!(e->table = e->own_table = tt_create(TT_BITS))) {
+    free(e);
+    return NULL;
+  }
+
+  engine = e;
+  game = (game_t) {11, 1, 0, W, W, OFF, NULL}; /* Default game settings */
+  return e;
+}
+
+/* Frees an engine that has no grid (or history, or search) yet */
+static void engine_free(engine_t *e) {
+  tt_free(e->own_table);
+  free(e);
+}
+
+/* Places a stone for the player to move and appends it to the history. Returns FALSE, */
+/* leaving the game as it was, if there's no memory for it */
+bool play_move(int row, int col) {
+  if(!history_push(row, col))
+    return FALSE;
+  set_hex(row, col, (game.current_player == W) ? 'w' : 'b');
+  return TRUE;
+}
+
+hex_engine *hex_create(int dimension) {
+  KEEP_CALLER_ENGINE;
+  char **grid;
+
+  if(dimension < MIN_DIMENSION || dimension > MAX_DIMENSION || !(grid = alloc_grid(dimension)))
+    return NULL;
+  if(!engine_new()) {
+    free_grid(grid);
+    return NULL;
+  }
+
+  game.dimension = dimension;
+  game.grid = grid;
+  game.cells = &game.grid[-1][-1];
+  empty_grid();
+  engine->first_game = game;
+  return engine;
+}
+
+/* The copy has no history (it can't undo the moves played so far), and must be destroyed */
+/* before <e>, whose table it uses */
+hex_engine *hex_clone(hex_engine *e) {
+  KEEP_CALLER_ENGINE;
+  char **grid;
+
+  engine = e;
+  game_t source = game;
+
+  if(!(grid = alloc_grid(source.dimension)))
+    return NULL;
+  if(!engine_new()) {
+    free_grid(grid);
+    return NULL;
+  }
+  hex_use_table(engine, e->table);
+
+  /* The keys and patterns come with the settings, so the cells are copied as they are */
+  game = source;
+  game.grid = grid;
+  game.cells = &game.grid[-1][-1];
+  copy_grid(game.grid, source.grid, game.dimension);
+
+  engine->first_game = game;
+  return engine;
+}
+
+void hex_destroy(hex_engine *e) {
+  engine_t *caller = (engine == e) ? NULL : engine; /* Destroying the current engine leaves none */
+
+  engine = e;
+
+  if(engine->first_game.grid != game.grid)
+    free_grid(engine->first_game.grid);
+
+  if(engine->searching) /* Takes the search's simulated moves back */
+    hex_search_stop(e, &(hex_result) {0});
+
+  history_free();
+  free_grid(game.grid);
+  search_free();
+  engine_free(engine);
+  engine = caller;
+}
+
+hex_table *hex_table_create(int bits) {
+  return tt_create(bits);
+}
+
+void hex_table_free(hex_table *table) {
+  tt_free(table);
+}
+
+/* Sharing a table frees the engine's own one, so that engines sharing a table stay small */
+int hex_use_table(hex_engine *e, hex_table *table) {
+  if(table) {
+    tt_free(e->own_table);
+    e->own_table = NULL;
+  }
+  else if(!e->own_table && !(e->own_table = tt_create(TT_BITS)))
+    return HEX_MEMALLOC_ERROR;
+
+  e->table = table ? table : e->own_table;
+  return HEX_NO_ERROR;
+}
+
+int hex_play(hex_engine *e, const char *move) {
+  char buffer[HEX_MAX_MOVE_STR];
+  int row, col;
+
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(engine->searching)
+    return HEX_SEARCH_IN_PROGRESS;
+  if(hex_winner(e) >= 0)
+    return HEX_GAME_OVER;
+
+  strncpy(buffer, move, sizeof(buffer)-1);
+  buffer[sizeof(buffer)-1] = '\0';
+  if(parse_move(buffer, &row, &col))
+    return HEX_INVALID_MOVE;
+  if(game.grid[row][col] != ' ')
+    return HEX_OCCUPIED_POSITION;
+
+  if(!history_push(row, col))
+    return HEX_MEMALLOC_ERROR;
+  set_hex(row, col, (game.current_player == W) ? 'w' : 'b');
+  game.current_player ^= 1;
+  return HEX_NO_ERROR;
+}
+
+int hex_undo(hex_engine *e) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(engine->searching)
+    return HEX_SEARCH_IN_PROGRESS;
+  if(!engine->history.ply)
+    return HEX_EMPTY_MOVE_LIST;
+
+  history_goto(engine->history.ply - 1);
+  history_truncate();
+  return HEX_NO_ERROR;
+}
+
+int hex_search_start(hex_engine *e, const hex_limits *limits) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(engine->searching)
+    return HEX_SEARCH_IN_PROGRESS;
+  if(hex_winner(e) >= 0)
+    return HEX_GAME_OVER;
+
+  engine->max_time = (limits && limits->seconds > 0) ? limits->seconds : MOVE_TIME_LIMIT;
+  engine->timer = wall_time();
+  engine->searching = TRUE;
+
+  search_start((limits && limits->depth > 0) ? min(limits->depth, game.dimension*game.dimension) : game.difficulty,
+               limits ? limits->lines : 1, limits ? limits->nodes : 0);
+  return HEX_NO_ERROR;
+}
+
+/* Fills in <result> with a move, its score and its variation (given as cells) */
+static void fill_result(hex_result *result, int cell, int score, const int *pv, int pv_length) {
+  result->row = cell / game.dimension;
+  result->col = cell % game.dimension;
+  move_str(result->row, result->col, result->move);
+  result->score = score;
+
+  /* The principal variation only counts if it starts with the move (if no iteration */
+  /* was completed, the move comes from an unfinished one, which has no variation) */
+  if(!pv_length || pv[0] != cell) {
+    pv = &cell;
+    pv_length = 1;
+  }
+
+  result->pv_length = pv_length;
+  for(int p = 0; p < pv_length; p++) {
+    result->pv[p].row = pv[p] / game.dimension;
+    result->pv[p].col = pv[p] % game.dimension;
+  }
+}
+
+/* Fills in <result> from a finished search */
+static void search_result(hex_result *result) {
+  Move best_move = engine->search.best_move;
+
+  engine->searching = FALSE;
+  fill_result(result, best_move.row*game.dimension + best_move.col, engine->search.score,
+              engine->best_pv, engine->best_pv_length);
+}
+
+int hex_search_step(hex_engine *e, long nodes, hex_result *result) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(!engine->searching)
+    return 1;
+  if(!search_run(nodes))
+    return 0;
+
+  search_result(result);
+  return 1;
+}
+
+void hex_search_stop(hex_engine *e, hex_result *result) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(!engine->searching)
+    return;
+
+  search_stop();
+  search_run(LONG_MAX); /* Only unwinds the search's stack */
+  search_result(result);
+}
+
+int hex_search_progress(hex_engine *e, hex_result *result) {
+  Move best_move = e->search.best_move;
+
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  fill_result(result, e->best_pv_length ? e->best_pv[0] : best_move.row*game.dimension + best_move.col,
+              e->search.score, e->best_pv, e->best_pv_length);
+  return e->search.completed_depth;
+}
+
+long hex_search_nodes(hex_engine *e) {
+  return e->search.nodes;
+}
+
+int hex_search(hex_engine *e, const hex_limits *limits, hex_result *result) {
+  int error = hex_search_start(e, limits);
+
+  if(!error) {
+    hex_search_step(e, LONG_MAX, result);
+    if(e->search.out_of_memory)
+      error = HEX_MEMALLOC_ERROR;
+  }
+  return error;
+}
+
+int hex_search_lines(hex_engine *e, hex_result *results) {
+  search_state *s = &e->search;
+
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  if(engine->searching)
+    return 0;
+  if(!s->best_line_count) { /* A single-move search, or no iteration was completed */
+    search_result(results);
+    return 1;
+  }
+
+  for(int k = 0; k < s->best_line_count; k++)
+    fill_result(&results[k], s->best_line[k].pv[0], s->best_line[k].score, s->best_line[k].pv,
+                s->best_line[k].pv_length);
+  return s->best_line_count;
+}
+
+int hex_winner(hex_engine *e) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+
+  if(game_finished(!PRINT_PATH, W))
+    return W;
+  if(game_finished(!PRINT_PATH, B))
+    return B;
+  return -1;
+}
+
+int hex_to_move(hex_engine *e) {
+  KEEP_CALLER_ENGINE;
+  engine = e;
+  return game.current_player;
+}
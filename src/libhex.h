@@ -0,0 +1,107 @@
+/* libhex: the Hex engine as a library.
+ *
+ * Every game lives in its own engine (an opaque hex_engine), so a process can run any number of
+ * games, and searches on different engines can run concurrently on different threads (even when
+ * they share a table). An engine must only be used by one thread at a time. The calls leave the
+ * calling thread's state (the engine the game's own code works on) as they found it.
+ *
+ * Functions returning int return HEX_NO_ERROR (0) or one of the HEX_* errors below.
+ * Moves are strings such as "B7" or "AC12" (see the README).
+ *
+ *   hex_engine *e = hex_create(11);
+ *   hex_result r;
+ *
+ *   hex_play(e, "F6");
+ *   hex_search(e, &(hex_limits) {3, 1.0}, &r);  (r.move holds Black's best reply)
+ *   hex_play(e, r.move);
+ *   hex_destroy(e);
+ */
+
+#ifndef LIBHEX_H
+#define LIBHEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HEX_NO_ERROR            0
+#define HEX_INVALID_MOVE        1 /* Not a move on the engine's grid */
+#define HEX_OCCUPIED_POSITION   3
+#define HEX_INVALID_ARGUMENT    4
+#define HEX_EMPTY_MOVE_LIST     5 /* There's no move to undo */
+#define HEX_MEMALLOC_ERROR      8
+#define HEX_GAME_OVER          15
+#define HEX_SEARCH_IN_PROGRESS 16 /* The engine is being searched: it can only be searched or destroyed */
+
+#define HEX_MAX_MOVE_STR 16
+#define HEX_MAX_PV 32
+#define HEX_MAX_LINES 8
+
+typedef struct hex_engine hex_engine;
+typedef struct hex_table hex_table; /* A transposition table (cache of position evaluations) */
+
+typedef struct hex_limits {
+  int depth; /* Maximum search depth, in plies (0 uses the engine's difficulty) */
+  double seconds; /* Time limit (0 uses the interactive game's 30 seconds) */
+  int lines; /* How many of the best moves to rank, up to HEX_MAX_LINES (0 or 1: only the best one) */
+  long nodes; /* If set, the search ends after this many nodes and the time limit is ignored: the */
+              /* result (and hex_search_nodes()) is then the same on any machine, under any load */
+} hex_limits;
+
+typedef struct hex_result {
+  int row, col; /* The best move */
+  char move[HEX_MAX_MOVE_STR];
+  int score; /* Its score for the player to move (INT_MAX: a forced win, -INT_MAX: a forced loss) */
+  int pv_length; /* The principal variation (at least the best move itself) */
+  struct { int row, col; } pv[HEX_MAX_PV];
+} hex_result;
+
+hex_engine *hex_create(int); /* Starts a game on a grid of the given size (NULL if it's invalid, or there's no memory) */
+hex_engine *hex_clone(hex_engine *); /* A new engine with the same position and settings, sharing its table (or NULL) */
+void hex_destroy(hex_engine *);
+
+/* Every engine starts with a table of its own (4MB). Engines may instead share one (eg. every */
+/* game of a server, across threads), which must then outlive them; NULL gives an engine its own again */
+hex_table *hex_table_create(int); /* A table of 2^bits entries, 16 bytes each (NULL if it can't be allocated) */
+void hex_table_free(hex_table *);
+int hex_use_table(hex_engine *, hex_table *);
+
+int hex_play(hex_engine *, const char *); /* Plays a move for the player to move */
+int hex_undo(hex_engine *); /* Takes back the last move */
+/* Finds the best move, without playing it. If the search runs out of memory it's cut short, as if */
+/* it were stopped: <result> holds the best move found by then, and HEX_MEMALLOC_ERROR is returned */
+int hex_search(hex_engine *, const hex_limits *, hex_result *);
+
+/* The best moves ranked by the last search (limits.lines of them, from one search), best first, */
+/* each with its score and variation; returns their count */
+int hex_search_lines(hex_engine *, hex_result *);
+
+/* The same search, run a slice at a time: it can be suspended between any two nodes and */
+/* resumed later, on any thread (the time limit only counts the time it runs). While it's under */
+/* way the engine's grid holds its simulated moves, so the engine can only be searched or destroyed */
+int hex_search_start(hex_engine *, const hex_limits *);
+int hex_search_step(hex_engine *, long, hex_result *); /* Runs up to <nodes> more nodes: 1 once it's over */
+void hex_search_stop(hex_engine *, hex_result *); /* Ends it with the best move so far */
+long hex_search_nodes(hex_engine *); /* The nodes searched so far */
+int hex_search_progress(hex_engine *, hex_result *); /* The depth completed so far, and its best move */
+
+/* A scheduler time-slices many searches on a few threads. Each search is either latency-critical */
+/* (weight 0: run before all others, earliest deadline first, the deadline being its time limit */
+/* from submission) or a background one, sharing the remaining time in proportion to its weight. */
+/* When a search is over, <done> gets its result on one of the scheduler's threads (with no */
+/* move if the game was already over); the engine is then free again */
+typedef struct hex_scheduler hex_scheduler;
+typedef void (*hex_done)(hex_engine *, const hex_result *, void *);
+
+hex_scheduler *hex_scheduler_create(int); /* Starts a scheduler with the given number of threads */
+void hex_scheduler_destroy(hex_scheduler *); /* Stops the pending searches (they're still reported) */
+int hex_scheduler_submit(hex_scheduler *, hex_engine *, const hex_limits *, int, hex_done, void *);
+void hex_scheduler_stop(hex_scheduler *, hex_engine *); /* Ends the engine's search, with the best move so far */
+int hex_winner(hex_engine *); /* The winner's colour (B: 0, W: 1), or -1 while the game is on */
+int hex_to_move(hex_engine *); /* The colour of the player to move */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
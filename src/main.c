@@ -6,51 +6,257 @@
 #include "hex.h"
 #include "grid.h"
 #include "directives.h"
+#include "history.h"
+#include "network.h"
+#include "evaluate.h"
+#include "pcache.h"
+#include "solver.h"
+#include "openings.h"
+#include "journal.h"
 
-game_t game = {11, 1, W, W, OFF, NULL}; /* Default game settings */
-game_t first_game; /* Saves the game settings passed from the command line */
+/* Parses and processes Command Line Arguments */
+static void process_CLA(int argc, char **argv) {
+  int argind;
+  for(argind = 1; argind < argc && argv[argind][0] == '-'; argind++) {
+    switch(argv[argind][1]) {
+      case 'n':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        
+        for(int i = 0; argv[argind][i] != '\0'; i++)
+          if(!is_digit(argv[argind][i])) {
+            fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+            exit(EXIT_FAILURE);
+          }
 
-extern Listptr first_move, last_move;
+        game.dimension = atoi(argv[argind]);
+        if(game.dimension < MIN_DIMENSION || game.dimension > MAX_DIMENSION) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'd':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        for(int i = 0; argv[argind][i] != '\0'; i++)
+          if(!is_digit(argv[argind][i])) {
+            fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+            exit(EXIT_FAILURE);
+          }
+
+        if((game.difficulty = atoi(argv[argind])) < 1) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'b':
+        game.user = B;
+        break;
+
+      case 'c':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(!pcache_open(argv[argind])) {
+          fprintf(stderr, "%s: Invalid position cache file\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'S':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(!solved_open(argv[argind])) {
+          fprintf(stderr, "%s: Invalid solved-position database\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'o':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(!openings_open(argv[argind])) {
+          fprintf(stderr, "%s: Invalid first-move table\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'j':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(!journal_open(argv[argind])) {
+          fprintf(stderr, "%s: Invalid journal file\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'e':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(load_weights(argv[argind], eval_weights)) {
+          fprintf(stderr, "%s: Invalid evaluator weights file\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'w':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        nn_free(network);
+        if(!(network = nn_load(argv[argind]))) {
+          fprintf(stderr, "%s: Invalid network weights file\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 's':
+        game.swap = ON;
+        break;
+
+      case 'q':
+        engine->quiet = TRUE;
+        break;
+
+      case 'i':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        if(!freopen(argv[argind], "r", stdin)) {
+          fprintf(stderr, "%s: Invalid script file\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'N':
+        if(!argv[++argind]) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+
+        for(int i = 0; argv[argind][i] != '\0'; i++)
+          if(!is_digit(argv[argind][i])) {
+            fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+            exit(EXIT_FAILURE);
+          }
+
+        if((engine->node_limit = atol(argv[argind])) < 1) {
+          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      default:
+        fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Takes care of option-arguments not starting with '-' */
+  if(argind < argc) {
+    fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  /* The game difficulty cannot exceed the maximum game-tree depth: game.dimension^2 */
+  if(game.difficulty > game.dimension*game.dimension) {
+    fprintf(stderr, "%s: Invalid game difficulty\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+}
 
 int main(int argc, char **argv) {
-  process_CLA(argc, argv);
-  init_grid();
-  first_game = game;
+  /* The interactive game is the only engine, with the default settings .. */
+  if(!engine_new()) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+  process_CLA(argc, argv); /* .. changed by the command line */
+  if(!init_grid()) {
+    print_error(MEMALLOC_ERROR);
+    exit(EXIT_FAILURE);
+  }
+  engine->first_game = game;
+  if(!journal_start()) { /* A journaled session (-j) goes on where it was left */
+    print_error(JOURNAL_ERROR);
+    exit(EXIT_FAILURE);
+  }
+  calibrate_level(); /* .. possibly on a level of the difficulty ladder */
 
-  srand(2); /* A constant seed is used in order for the games to be able to be reproduced */
+  /* Scripted sessions (-q) have their output written in large blocks */
+  if(engine->quiet)
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
 
   /* The program never exits this loop: it either terminates when the */
   /* "quit" directive is given or when an error occurs (eg. malloc error) */
   while(TRUE) {
+    char **directive;
+
+    /* Directives are read until one of them ends the current player's turn */
     print_current_player();
-    process(next_directive());
+    do
+      directive = next_directive();
+    while(!process(directive));
 
     /* Check if the current player has won (if he has, the winning path will be printed) */
     if(game_finished(PRINT_PATH, game.current_player)) {
-      fflush(stdout);
+      if(!engine->quiet)
+        fflush(stdout);
 
       /* Since the game has finished, only the directives seen below are valid at this point */
-      char **directive = next_directive();
+      /* (besides those that review it, which leave the game finished) */
+      directive = next_directive();
       while(directive[0] != NULL
             && strcmp(directive[0], "newgame") != 0
             && strcmp(directive[0], "level") != 0
             && strcmp(directive[0], "quit") != 0)
       {
-        print_error(INVALID_DIRECTIVE);
-        dealloc_char(MAX_WORDS, directive);
+        int dir_ind = get_index(directive);
+
+        if(dir_ind == GOTO || dir_ind == BACK || dir_ind == FORWARD || dir_ind == REPLAY || dir_ind == SHOWSTATE)
+          process(directive);
+        else
+          print_error(INVALID_DIRECTIVE);
         directive = next_directive();
       }
 
-      /* Restart the game and continue by processing the next directive */
+      /* Restart the game and continue by processing the next directives */
       game.current_player = W;
       empty_grid();
-      delete_move_list(&first_move);
-      first_move = last_move = NULL;
-      process(directive);
+      history_clear();
+      journal_game();
+      while(!process(directive))
+        directive = next_directive();
     }
 
     game.current_player ^= 1; /* End of current player's move */
-    fflush(stdout);
+    if(!engine->quiet)
+      fflush(stdout);
   }
 
   return 0;
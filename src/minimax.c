@@ -1,106 +1,686 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "hex.h"
 #include "grid.h"
 #include "directives.h"
+#include "ttable.h"
+#include "network.h"
+#include "evaluate.h"
+#include "pcache.h"
+#include "solver.h"
+#include "patterns.h"
+#include "templates.h"
+#include "tactics.h"
+
+/* Makes <cell> followed by the next ply's variation the variation of <ply> */
+static void update_pv(int ply, int cell) {
+  if(ply >= MAX_PV)
+    return;
+
+  engine->pv[ply][ply] = cell;
+  engine->pv_length[ply] = ply+1;
+  if(ply+1 < MAX_PV)
+    for(int p = ply+1; p < engine->pv_length[ply+1]; p++)
+      engine->pv[ply][engine->pv_length[ply]++] = engine->pv[ply+1][p];
+}
 
-extern game_t game;
-extern clock_t timer;
-extern double max_time;
+/* How an iteration stopped running (see run_iteration()) */
+#define ITERATION_DONE      0
+#define ITERATION_SUSPENDED 1
+#define ITERATION_ABORTED   2
+
+/* Fills <dist> (indexed like game.cells) with the fewest empty cells <player> needs to join each */
+/* cell to the player's top or left edge (TP_NEAR) or to the other one (TP_FAR), counting the */
+/* cell itself: a 0-1 BFS, one level of distance at a time. Unreachable cells are left at INF */
+static void edge_distances(Colour player, int side, int *dist) {
+  static _Thread_local int queue[2][MAX_CELLS];
+  const int *offset = neighbour[game.dimension];
+  int n = game.dimension, count[2] = {0, 0}, level = 0;
+  char blocked = (player == W) ? 'b' : 'w';
+
+  for(int c = 0; c < STRIDE(n)*STRIDE(n); c++)
+    dist[c] = INF;
+
+  /* The cells next to the edge start at their own cost */
+  for(int k = 0; k < n; k++) {
+    int line = (side == TP_NEAR) ? 0 : n-1;
+    int c = (player == W) ? cell_of(line, k) : cell_of(k, line);
+
+    if(game.cells[c] == blocked)
+      continue;
+    dist[c] = (game.cells[c] == ' ');
+    queue[dist[c]][count[dist[c]]++] = c;
+  }
 
-int minimax(int depth, bool is_maximizing_plr, int a, int b, Move *best_move, int *critical) {
-  if(!depth && calc_time(timer) < max_time)
-    return static_evaluate(game.current_player);
+  while(count[0] || count[1]) {
+    /* Cells reached through stones of the player stay on the current level */
+    for(int q = 0; q < count[0]; q++) {
+      int c = queue[0][q];
+
+      if(dist[c] != level)
+        continue;
+      for(int d = 0; d < DIRECTIONS; d++) {
+        int next = c + offset[d];
+        char hex = game.cells[next];
+
+        if(hex == BORDER || hex == blocked || dist[next] <= level + (hex == ' '))
+          continue;
+        dist[next] = level + (hex == ' ');
+        if(hex == ' ')
+          queue[1][count[1]++] = next;
+        else
+          queue[0][count[0]++] = next;
+      }
+    }
 
-  int eval;
-  if(is_maximizing_plr) { /* Maximizing player's turn */
-    int max_eval = -INF; /* Initially, any move is the best option for max */
-    
-    /* Regard every possible move the maximizing player can play as a next game state */
-    for(int i = 0; i < game.dimension && calc_time(timer) < max_time; i++) {
-      for(int j = 0; j < game.dimension; j++) {
-        if(game.grid[i][j] == ' ' && calc_time(timer) < max_time) {
-          game.grid[i][j] = (game.current_player == W) ? 'w' : 'b'; /* Simulate next game state */
-          eval = minimax(depth-1, FALSE, a, b, best_move, critical);
-          
-          /* If the opponent has a winning move (in the next round), then */
-          /* there is no need to search further, the priority is to block it */
-          if(*critical == -INF) {
-            game.grid[i][j] = ' '; /* Undo the simulation */
-            return *critical;
-          }
+    memcpy(queue[0], queue[1], count[1] * sizeof(int));
+    count[0] = count[1];
+    count[1] = 0;
+    level++;
+  }
+}
+
+/* The (row, column) offsets of a cell's neighbours, by direction, and of the cells it would be */
+/* joined to by a bridge (the d-th one lies between the neighbours in directions d and d+1) */
+static const int near_cell[DIRECTIONS][2] = {{-1, 0}, {-1, 1}, {0, 1}, {1, 0}, {1, -1}, {0, -1}};
+static const int bridge_cell[DIRECTIONS][2] = {{-2, 1}, {-1, 2}, {1, 1}, {2, -1}, {1, -2}, {-1, -1}};
+
+/* Keeps the <width> best of <mover>'s <move_cnt> moves, best first, by a cheap score: how close */
+/* each cell is to lying on one of the players' shortest paths between their edges (cells on */
+/* both come first), and then the local patterns' prior. Returns how many moves are kept */
+static int select_moves(int *moves, int move_cnt, int width, Colour mover) {
+  static _Thread_local int dist[2][MAX_BORDERED_CELLS], slack[2][MAX_CELLS];
+  int n = game.dimension, score[move_cnt];
+
+  if(move_cnt <= 1)
+    return move_cnt;
+
+  for(Colour player = B; player <= W; player++) {
+    int shortest = INF;
+
+    edge_distances(player, TP_NEAR, dist[0]);
+    edge_distances(player, TP_FAR, dist[1]);
+
+    /* A cell's own cost is counted from both edges */
+    for(int m = 0; m < move_cnt; m++) {
+      int c = cell_of(moves[m] / n, moves[m] % n);
+      slack[player][m] = (dist[0][c] == INF || dist[1][c] == INF) ? INF : dist[0][c] + dist[1][c] - 1;
+      shortest = min(shortest, slack[player][m]);
+    }
+    for(int m = 0; m < move_cnt; m++)
+      slack[player][m] = (shortest == INF) ? n : min(slack[player][m] - shortest, n);
+  }
+
+  for(int m = 0; m < move_cnt; m++) {
+    int i = moves[m] / n, j = moves[m] % n, stones = 0;
+
+    for(int d = 0; d < DIRECTIONS; d++) {
+      int r = i + near_cell[d][0], c = j + near_cell[d][1];
+      int br = i + bridge_cell[d][0], bc = j + bridge_cell[d][1];
+
+      stones += (r >= 0 && r < n && c >= 0 && c < n && game.grid[r][c] != ' ');
+      stones += (br >= 0 && br < n && bc >= 0 && bc < n && game.grid[br][bc] != ' ');
+    }
+
+    score[m] = (-(slack[W][m] + slack[B][m]) * 4 + min(stones, 3)) * 256 + pattern_prior[mover][game.pattern[moves[m]]];
+  }
+
+  /* Selection sort: the first of equally scored moves (in the order given) goes first */
+  width = min(width, move_cnt);
+  for(int k = 0; k < width; k++) {
+    int best = k;
+
+    for(int m = k+1; m < move_cnt; m++)
+      if(score[m] > score[best])
+        best = m;
+
+    int move = moves[best], value = score[best];
+    memmove(moves + k+1, moves + k, (best - k) * sizeof(int));
+    memmove(score + k+1, score + k, (best - k) * sizeof(int));
+    moves[k] = move;
+    score[k] = value;
+  }
+
+  return width;
+}
+
+/* Starts a node of <depth> plies on top of the search's stack, generating its moves. A selective */
+/* search (see search_start()) keeps each node's best few, unless it's verifying its move, in */
+/* which case that move is tried first and every node below the root is searched at full width. */
+/* Returns FALSE, pushing nothing, if the stacks can't grow */
+static bool push_frame(search_state *s, int depth, bool maximizing, int a, int b) {
+  int ply = game.difficulty - depth;
+  if(ply < MAX_PV)
+    engine->pv_length[ply] = ply; /* Empty, until a move is found */
+
+  int moves = s->frame_count ? s->frames[s->frame_count-1].moves + s->frames[s->frame_count-1].move_cnt : 0;
+  if(moves + game.dimension*game.dimension > s->move_stack_size) {
+    int size = 2*(moves + game.dimension*game.dimension), *stack = realloc(s->move_stack, size * sizeof(int));
+
+    if(!stack)
+      return FALSE;
+    s->move_stack = stack;
+    s->move_stack_size = size;
+  }
+  if(s->frame_count == s->frame_size) {
+    int size = s->frame_size ? 2*s->frame_size : 16;
+    search_frame *frames = realloc(s->frames, size * sizeof(search_frame));
+
+    if(!frames)
+      return FALSE;
+    s->frames = frames;
+    s->frame_size = size;
+  }
+
+  search_frame *f = &s->frames[s->frame_count++];
+  *f = (search_frame) {depth, maximizing, a, b, maximizing ? -INF : INF, moves, 0, 0};
+  Colour mover = (maximizing == (game.current_player == W)) ? W : B;
+  bool selective = s->beam && !(s->verifying && ply > 0);
+  int *move = s->move_stack + moves;
+
+  if(!ply && s->forced >= 0) { /* Any other move loses at once */
+    move[0] = s->forced;
+    f->move_cnt = 1;
+    return TRUE;
+  }
+
+  f->move_cnt = generate_moves(move, depth > 1 && !selective, mover);
+  if(selective)
+    f->move_cnt = select_moves(move, f->move_cnt, ply ? max(s->beam >> ply, BEAM_MIN_WIDTH) : s->beam, mover);
+
+  if(s->verifying && !ply)
+    for(int m = 1; m < f->move_cnt; m++)
+      if(move[m] == s->completed_move.row*game.dimension + s->completed_move.col) {
+        memmove(move + 1, move, m * sizeof(int));
+        move[0] = s->completed_move.row*game.dimension + s->completed_move.col;
+        break;
+      }
+  return TRUE;
+}
+
+/* The cell of the move the top frame is trying */
+static int current_cell(search_state *s) {
+  search_frame *f = &s->frames[s->frame_count-1];
+  return s->move_stack[f->moves + f->m];
+}
+
+/* Ranks the root move <cell>, whose evaluation is <eval>, among the best ones (multi-PV search). */
+/* Its variation is the one the move's node has just built */
+static void add_line(search_state *s, int cell, int eval) {
+  int k;
 
-          if(max_eval < eval) {
-            max_eval = eval;
+  if(s->line_count == s->lines && s->line[s->lines-1].score >= eval)
+    return;
 
-            /* Update the best move only at the top level of the game tree */
-            if(depth == game.difficulty) {
-              best_move->row = i;
-              best_move->col = j;
+  /* Moves with equal scores keep the order they were searched in */
+  for(k = min(s->line_count, s->lines-1); k > 0 && s->line[k-1].score < eval; k--)
+    s->line[k] = s->line[k-1];
+  s->line_count = min(s->line_count+1, s->lines);
 
-              if(max_eval == INF) {
-                game.grid[i][j] = ' '; /* Undo the current simulation */
-                *critical = INF; /* Notify the caller function that a winning move is available */
-                return max_eval; /* No need to search further */
-              }
+  search_line *line = &s->line[k];
+  line->score = eval;
+  line->pv[0] = cell;
+  line->pv_length = 1;
+  for(int p = 1; p < engine->pv_length[1] && p < MAX_PV; p++)
+    line->pv[line->pv_length++] = engine->pv[1][p];
+
+  if(!k)
+    update_pv(0, cell);
+}
+
+/* Checks whether the search has used up its node budget (or run into its time cap), or else its time */
+static bool out_of_budget(search_state *s) {
+  if(s->stopped)
+    return TRUE;
+  if(s->max_nodes)
+    return s->nodes >= s->max_nodes || (engine->time_cap && calc_time(engine->timer) >= engine->time_cap);
+  return calc_time(engine->timer) >= engine->max_time;
+}
+
+/* Checks whether a selective search has used up half of its budget: its next iteration would */
+/* most likely not finish, so its move is verified instead */
+static bool half_budget_spent(search_state *s) {
+  if(s->max_nodes)
+    return s->nodes >= s->max_nodes/2;
+  return calc_time(engine->timer) >= engine->max_time/2;
+}
+
+/* Takes back the moves on the search's path and empties its stack */
+static void abort_iteration(search_state *s) {
+  /* Every frame but the top one is in the middle of one of its moves */
+  for(s->frame_count--; s->frame_count > 0; s->frame_count--) {
+    int cell = current_cell(s);
+    set_hex(cell / game.dimension, cell % game.dimension, ' ');
+  }
+}
+
+/* Runs the current iteration (an alpha-beta search of game.difficulty plies, from the frame at */
+/* the bottom of the stack) for at most *<budget> more nodes. Returns ITERATION_DONE, with the */
+/* root's evaluation in <value>, ITERATION_SUSPENDED when the budget is spent, or ITERATION_ABORTED */
+/* if the search's own budget (nodes or time) ran out: an unfinished node's evaluation means nothing, so the iteration is dropped */
+/* (search_run() then falls back on the last completed iteration's move) */
+static int run_iteration(search_state *s, long *budget, int *value) {
+  /* A beam also drops the opponent's replies, so a selective iteration's win or loss isn't */
+  /* proven: it's scored like any other evaluation, and only full-width nodes end the search */
+  bool full_width = !s->beam || s->verifying;
+
+  while(TRUE) {
+    search_frame *f = &s->frames[s->frame_count-1];
+    int eval, cell;
+
+    if(out_of_budget(s)) {
+      abort_iteration(s);
+      return ITERATION_ABORTED;
+    }
+
+    if(f->m == f->move_cnt) { /* Every move has been tried: the node is done */
+      eval = f->best;
+      s->frame_count--;
+    }
+    else {
+      if(*budget <= 0)
+        return ITERATION_SUSPENDED;
+      (*budget)--;
+      s->nodes++;
+
+      /* Simulate the next game state */
+      cell = current_cell(s);
+      set_hex(cell / game.dimension, cell % game.dimension,
+              (f->maximizing == (game.current_player == W)) ? 'w' : 'b');
+
+      if(f->depth > 1) {
+        if(!push_frame(s, f->depth-1, !f->maximizing, f->a, f->b)) {
+          /* Out of memory: the move is taken back and the search ends, as if it were stopped */
+          set_hex(cell / game.dimension, cell % game.dimension, ' ');
+          s->out_of_memory = s->stopped = TRUE;
+        }
+        continue;
+      }
+
+      if(game.difficulty < MAX_PV)
+        engine->pv_length[game.difficulty] = game.difficulty;
+      eval = static_evaluate(game.current_player, f->a, f->b);
+    }
+
+    /* Hands <eval> to the node below, which may in turn be done (as a recursive call would return) */
+    while(TRUE) {
+      if(!s->frame_count) {
+        *value = eval;
+        return ITERATION_DONE;
+      }
+
+      f = &s->frames[s->frame_count-1];
+      cell = current_cell(s);
+      int ply = game.difficulty - f->depth;
+      int i = cell / game.dimension, j = cell % game.dimension;
+      bool done = FALSE;
+
+      if(f->maximizing && f->depth == game.difficulty && s->lines > 1) {
+        /* Multi-PV: every root move that might be among the best ones needs its exact score, */
+        /* so the root's alpha is the score to beat to get in, not the best score */
+        add_line(s, cell, eval);
+        f->best = s->line[0].score;
+        s->best_move.row = s->line[0].pv[0] / game.dimension;
+        s->best_move.col = s->line[0].pv[0] % game.dimension;
+
+        if(s->line_count == s->lines)
+          f->a = s->line[s->lines-1].score;
+        done = f->a >= f->b;
+        eval = f->best;
+      }
+      else if(f->maximizing) {
+        /* If the opponent has a winning move (in the next round), then */
+        /* there is no need to search further, the priority is to block it */
+        if(s->critical == -INF) {
+          eval = s->critical;
+          done = TRUE;
+        }
+        else if(f->best < eval) {
+          f->best = eval;
+          update_pv(ply, cell);
+
+          /* Update the best move only at the top level of the game tree */
+          if(f->depth == game.difficulty) {
+            s->best_move.row = i;
+            s->best_move.col = j;
+
+            if(f->best == INF && full_width) {
+              s->critical = INF; /* A winning move is available, no need to search further */
+              done = TRUE;
             }
           }
+        }
+
+        if(!done) {
+          f->a = max(eval, f->a);
+          done = f->a >= f->b;
+          eval = f->best;
+        }
+      }
+      else {
+        if(f->best > eval) {
+          f->best = eval;
+          update_pv(ply, cell);
+
+          /* Update the best move if the opponent has a winning move in the next round */
+          if(f->depth == game.difficulty-1 && f->best == -INF && s->lines == 1 && full_width) {
+            /* Save the opponent's winning move to block it */
+            s->best_move.row = i;
+            s->best_move.col = j;
+
+            s->critical = -INF; /* The opponent has a winning move (in the next round), */
+            done = TRUE;        /* no need to search further */
+          }
+        }
 
-          game.grid[i][j] = ' '; /* Undo the simulation */
-          a = max(eval, a);
-          if(a >= b) return max_eval;
+        if(!done) {
+          f->b = min(eval, f->b);
+          done = f->a >= f->b;
+          eval = f->best;
         }
       }
+
+      set_hex(i, j, ' '); /* Undo the simulation */
+      if(!done) {
+        f->m++;
+        break;
+      }
+      s->frame_count--;
     }
+  }
+}
+
+/* Keeps the root's variation, once an iteration has completed */
+static void save_pv(void) {
+  engine->best_pv_length = engine->pv_length[0];
+  memcpy(engine->best_pv, engine->pv[0], sizeof(engine->best_pv));
+}
+
+/* Ends the search: the best move is stored in the persistent cache if an iteration completed */
+static void finish_search(search_state *s) {
+  game.difficulty = s->saved_difficulty;
+  if(s->completed_depth && s->lines == 1)
+    pcache_store(s->key, s->transform, s->completed_depth, &s->best_move, s->score);
+  s->finished = TRUE;
+}
+
+/* Sets up an iterative deepening search of up to <depth> plies, ranking the <lines> best moves. */
+/* It ends after <nodes> nodes if that's set, so its result doesn't depend on the machine */
+/* (unless engine->time_cap cuts it short), or else under the limits in engine->max_time */
+/* (counting only the time the search runs) and engine->timer. Grids bigger than MAX_DIM are */
+/* searched selectively, by a beam that narrows with each ply, and its move is then re-searched */
+/* VERIFY_DEPTH plies deep at full width, within the same budget (if the verification doesn't */
+/* finish, the beam's move stands). Single-move results are looked up in the solved-position */
+/* database and in (and added to) the persistent cache, if they are open, in which case the */
+/* search is over at once. So it is when the tactical pre-search finds a move that wins, makes a */
+/* double threat or only delays a loss, while a forced block is the only move searched */
+void search_start(int depth, int lines, long nodes) {
+  search_state *s = &engine->search;
+  int moves[game.dimension*game.dimension], cell;
+
+  s->finished = FALSE;
+  s->score = s->completed_depth = s->critical = 0;
+  s->frame_count = 0;
+  s->nodes = 0;
+  s->max_nodes = max(nodes, 0);
+  s->stopped = s->out_of_memory = FALSE;
+  s->lines = min(max(lines, 1), MAX_LINES);
+  s->beam = (game.dimension > MAX_DIM) ? max(BEAM_WIDTH, s->lines) : 0;
+  s->verifying = FALSE;
+  s->line_count = s->best_line_count = 0;
+  s->saved_difficulty = game.difficulty;
+  s->max_difficulty = max(depth, 1);
+  s->suspended_at = wall_time();
+  engine->best_pv_length = 0;
+
+  /* Some move is available even if the first iteration never finishes one */
+  s->best_move.row = s->best_move.col = 0;
+  if(generate_moves(moves, FALSE, game.current_player)) {
+    s->best_move.row = moves[0] / game.dimension;
+    s->best_move.col = moves[0] % game.dimension;
+  }
 
-    return max_eval;
+  int tactic = tactics(game.current_player, &cell);
+
+  s->forced = (tactic == TACTIC_BLOCK) ? cell : -1;
+  if(tactic != TACTIC_NONE) {
+    s->best_move.row = cell / game.dimension;
+    s->best_move.col = cell % game.dimension;
+  }
+  if(tactic != TACTIC_NONE && tactic != TACTIC_BLOCK) {
+    s->score = (tactic == TACTIC_LOST) ? -INF : INF;
+    s->completed_depth = (tactic == TACTIC_WIN) ? 1 : (tactic == TACTIC_LOST) ? 2 : 3; /* Plies to the end */
+    engine->best_pv[0] = cell;
+    engine->best_pv_length = 1;
+    s->finished = TRUE;
+    return;
   }
-  else { /* Minimizing player's turn */
-    int min_eval = INF; /* Initially, any move is the worst option for min */
 
-    /* Regard every possible move the minimizing player can play as a next game state */
-    for(int i = 0; i < game.dimension && calc_time(timer) < max_time; i++) {
+  s->key = pcache_key(&s->transform);
+
+  /* A search with a node budget rarely reaches its nominal depth (n*n plies, on the difficulty */
+  /* ladder), so it's satisfied by the depth that the same budget completed last time */
+  int wanted = s->max_difficulty;
+  if(s->max_nodes && s->max_nodes == engine->budget_nodes)
+    wanted = min(wanted, engine->budget_depth);
+
+  /* Small grids are answered by the solved-position database (or the solver) */
+  if(s->lines == 1 && (solved_probe(&s->best_move, &s->score, engine->time_cap ? engine->timer + engine->time_cap : 0)
+     || pcache_probe(s->key, s->transform, wanted, &s->best_move, &s->score))) {
+    s->finished = TRUE;
+    return;
+  }
+
+  game.difficulty = 1;
+}
+
+/* Runs the search for at most <budget> more nodes, returning TRUE once it's over: its best */
+/* move and score are then in engine->search. Time spent suspended doesn't count */
+bool search_run(long budget) {
+  search_state *s = &engine->search;
+  int value;
+
+  if(s->finished)
+    return TRUE;
+
+  engine->timer += wall_time() - s->suspended_at;
+
+  while(TRUE) {
+    if(!s->frame_count) {
+      s->critical = s->line_count = 0;
+      if(!push_frame(s, game.difficulty, TRUE, -INF, INF))
+        s->out_of_memory = TRUE;
+    }
+
+    switch(s->frame_count ? run_iteration(s, &budget, &value) : ITERATION_ABORTED) {
+      case ITERATION_SUSPENDED:
+        s->suspended_at = wall_time();
+        return FALSE;
+
+      case ITERATION_ABORTED:
+        /* A partly searched iteration only knows that its best move beats the moves it has */
+        /* searched so far, so the last completed iteration's move is kept */
+        if(s->completed_depth)
+          s->best_move = s->completed_move;
+        if(s->max_nodes && !s->stopped && s->completed_depth) {
+          engine->budget_nodes = s->max_nodes;
+          engine->budget_depth = s->completed_depth;
+        }
+        finish_search(s);
+        return TRUE;
+    }
+
+    if(s->critical == INF || s->critical == -INF) { /* Critical move found, stop the search */
+      s->score = s->critical;
+      s->completed_depth = (s->critical == INF) ? PC_PROVEN : game.difficulty;
+      save_pv();
+      finish_search(s);
+      return TRUE;
+    }
+
+    /* A verification is shallower than the selective iterations, but its move replaces theirs */
+    s->score = value;
+    if(!s->verifying)
+      s->completed_depth = game.difficulty;
+    s->completed_move = s->best_move;
+    save_pv();
+    memcpy(s->best_line, s->line, sizeof(s->line));
+    s->best_line_count = s->line_count;
+
+    if(s->verifying) {
+      finish_search(s);
+      return TRUE;
+    }
+    if(s->beam && game.difficulty > 1 && (game.difficulty == s->max_difficulty || half_budget_spent(s))) {
+      s->verifying = TRUE;
+      game.difficulty = min(game.difficulty, VERIFY_DEPTH);
+      continue;
+    }
+
+    if(game.difficulty++ == s->max_difficulty) {
+      finish_search(s);
+      return TRUE;
+    }
+  }
+}
+
+void search_stop(void) {
+  engine->search.stopped = TRUE;
+}
+
+void search_free(void) {
+  free(engine->search.frames);
+  free(engine->search.move_stack);
+}
+
+/* Searches game.difficulty plies deep, storing the best move in <best_move> and returning its score */
+int search(Move *best_move) {
+  search_start(game.difficulty, 1, 0);
+  search_run(LONG_MAX);
+
+  *best_move = engine->search.best_move;
+  return engine->search.score;
+}
+
+/* Stores <mover>'s moves (as row*game.dimension + col) in <moves> and returns their count: the */
+/* empty cells, leaving out cells made redundant by the grid's symmetry and cells the local */
+/* patterns show to be useless to <mover>, and, once the opponent's edges are virtually joined */
+/* (templates.h), cells outside the joins' carriers (unless no other move is left). */
+/* The cells are in row-major order, unless <ordered> is set, in which case they are sorted (best */
+/* first) by the network's move prior if a network is loaded, or else by the patterns' prior */
+int generate_moves(int *moves, bool ordered, Colour mover) {
+  int move_cnt = 0;
+  bool symmetric = is_symmetric(ROTATE_180);
+  uint64_t carriers[MAX_DIMENSION];
+  stone_lines lines;
+
+  /* Any other move leaves every one of the opponent's joins intact, and so loses */
+  get_stone_lines(&lines);
+  bool must_cut = (virtual_reach(&lines, !mover, carriers) == 2*game.dimension);
+
+  for(bool prune = TRUE; !move_cnt; prune = FALSE) {
+    bool pruned = FALSE;
+
+    for(int i = 0; i < game.dimension; i++)
       for(int j = 0; j < game.dimension; j++) {
-        if(game.grid[i][j] == ' ' && calc_time(timer) < max_time) {
-          game.grid[i][j] = (game.current_player == W) ? 'b' : 'w'; /* Simulate next game state */
-          eval = minimax(depth-1, TRUE, a, b, best_move, critical);
-
-          if(min_eval > eval) {
-            min_eval = eval;
-
-            /* Update the best move if the opponent has a winning move in the next round */
-            if(depth == game.difficulty-1 && min_eval == -INF) {
-              /* Save the opponent's winning move to block it */
-              best_move->row = i;
-              best_move->col = j;
-
-              game.grid[i][j] = ' '; /* Undo the current simulation */
-              *critical = -INF; /* Notify the caller function that the opponent has a winning */
-              return min_eval;  /* move (in the next round). No need to search further */
-            }
-          }
+        if(game.grid[i][j] != ' ')
+          continue;
+
+        /* On a symmetric grid (eg. the empty one), a move and its rotation are equivalent, */
+        /* so only the first of the two (in row-major order) is searched */
+        if(symmetric) {
+          int t_row = i, t_col = j;
+          transform_cell(ROTATE_180, &t_row, &t_col);
+          if(t_row*game.dimension + t_col < i*game.dimension + j)
+            continue;
+        }
 
-          game.grid[i][j] = ' '; /* Undo the simulation */
-          b = min(eval, b);
-          if(a >= b) return min_eval;
+        /* A stone there would be no better than a pass, or couldn't cut the opponent's joins */
+        if(prune && ((pattern_flags[game.pattern[i*game.dimension + j]] & PT_CAPTURED(!mover))
+                     || (must_cut && !(carriers[i] >> j & 1)))) {
+          pruned = TRUE;
+          continue;
         }
+
+        moves[move_cnt++] = i*game.dimension + j;
       }
-    } 
 
-    return min_eval;
+    if(!pruned)
+      break;
+  }
+
+  if(ordered && move_cnt > 1) {
+    int value, prior[game.dimension*game.dimension];
+
+    /* Without the network's priors (or memory for them), the patterns' are used */
+    if(!network || !nn_evaluate_batch(network, 1, &game.grid, game.dimension, &value, prior))
+      for(int m = 0; m < move_cnt; m++)
+        prior[moves[m]] = pattern_prior[mover][game.pattern[moves[m]]];
+
+    /* Insertion sort is stable, so cells with equal priors keep their row-major order */
+    for(int m = 1; m < move_cnt; m++) {
+      int move = moves[m], k = m;
+
+      while(k > 0 && prior[moves[k-1]] < prior[move]) {
+        moves[k] = moves[k-1];
+        k--;
+      }
+      moves[k] = move;
+    }
   }
+
+  return move_cnt;
 }
 
-/* Returns an evaluation that determines the quality of a game state for <player> */
-int static_evaluate(Colour player) {
-  /* Check whether either player has won, returning the corresponding evaluation in each case */
-  if(game_finished(!PRINT_PATH, player))  return  INF;
-  if(game_finished(!PRINT_PATH, !player)) return -INF;
-  
-  /* If neither has won, then compute the grid's quality based on a heuristic function */
-  return hexes_needed_to_win_difference(player);
+/* Returns an evaluation that determines the quality of a game state for <player>, in stages */
+/* (a lazy cascade) that stop once the evaluation is known to fall outside the player's window */
+/* (<alpha>, <beta>): the table, the win checks (a player can only have won if their stones */
+/* occupy every one of their lines), and the evaluator's own stages (see weighted_evaluate()). */
+/* Outside the window, the result may be just a bound (at most alpha, or at least beta) */
+int static_evaluate(Colour player, int alpha, int beta) {
+  int lower, upper; /* Bounds of White's evaluation (Black's is its negation) */
+  int a = (player == W) ? alpha : -beta, b = (player == W) ? beta : -alpha; /* White's window */
+  int transform;
+  uint64_t key = canonical_key(FALSE, &transform);
+  bool hit = tt_probe(key, &lower, &upper);
+
+  /* Positions reached through different move orders, or symmetric to each other, are only */
+  /* evaluated once (as far as their windows need). The table holds White's evaluation of the */
+  /* canonical position, which is Black's evaluation of this one if the symmetry swaps the colours */
+  if(hit && swaps_colours(transform)) {
+    int bound = lower;
+    lower = -upper;
+    upper = -bound;
+  }
+
+  if(!hit || (lower < upper && upper > a && lower < b)) {
+    stone_count count;
+
+    count_stones(&count);
+
+    /* Check whether either player has won, returning the corresponding evaluation in each case */
+    if(count.lines[W] == game.dimension && game_finished(!PRINT_PATH, W))
+      lower = upper = INF;
+    else if(count.lines[B] == game.dimension && game_finished(!PRINT_PATH, B))
+      lower = upper = -INF;
+    /* If neither has won, then compute the grid's quality based on the network (if it has */
+    /* the memory it needs) .. */
+    else if(network && nn_evaluate_batch(network, 1, &game.grid, game.dimension, &lower, NULL))
+      upper = lower;
+    else /* .. or a weighted combination of heuristic functions */
+      weighted_evaluate(&count, a, b, &lower, &upper);
+
+    if(swaps_colours(transform))
+      tt_store(key, -upper, -lower);
+    else
+      tt_store(key, lower, upper);
+  }
+
+  int eval = (upper <= a) ? upper : lower;
+  return (player == W) ? eval : -eval;
 }
 
 /* Explores the grid (BFS) and returns the difference of */
@@ -109,78 +689,55 @@ int hexes_needed_to_win_difference(Colour player) {
   int hexes_needed_for_white = INF;
   int hexes_needed_for_black = INF;
 
-  int **cost_matrix;
-  int trans_cost;
-
-  /* Allocate memory for the cost matrix */
-  if(!(cost_matrix = malloc(sizeof(int *) * game.dimension))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-  for(int i = 0; i < game.dimension; i++)
-    if(!(cost_matrix[i] = malloc(sizeof(int) * game.dimension))) {
-      print_error(MEMALLOC_ERROR);
-      exit(EXIT_FAILURE);
-    }
+  static _Thread_local int cost_matrix[MAX_BORDERED_CELLS]; /* Indexed like game.cells */
+  const int *offset = neighbour[game.dimension];
+  int c, next;
 
   init_cost_matrix(cost_matrix, W);
 
   /* Compute the hexes needed for the white player to win (conducts an up-to-down BFS search) */
   for(int i = 0; i < game.dimension; i++) {
     for(int j = 0; j < game.dimension; j++) {
-      if(game.grid[i][j] == 'b') continue; /* 'b' -> anything : infinite cost (for the W player), so skip 'b' */
-
-      /* Right Neighbour */
-      if((trans_cost = transition_cost(i, j+1, W)) != -1)
-        cost_matrix[i][j+1] = min(cost_matrix[i][j+1], add(cost_matrix[i][j],trans_cost));
-      
-      /* Left Neighbour */
-      if((trans_cost = transition_cost(i, j-1, W)) != -1)
-        cost_matrix[i][j-1] = min(cost_matrix[i][j-1], add(cost_matrix[i][j],trans_cost));
-      
-      /* Down-Left Neighbour */
-      if((trans_cost = transition_cost(i+1, j-1, W)) != -1)
-        cost_matrix[i+1][j-1] = min(cost_matrix[i+1][j-1], add(cost_matrix[i][j],trans_cost));
-      
-      /* Down Neighbour */
-      if((trans_cost = transition_cost(i+1, j, W)) != -1)
-        cost_matrix[i+1][j] = min(cost_matrix[i+1][j], add(cost_matrix[i][j],trans_cost));
+      c = cell_of(i, j);
+      if(game.cells[c] == 'b') continue; /* 'b' -> anything : infinite cost (for the W player), so skip 'b' */
+
+      /* Right, Left, Down-Left and Down Neighbours (the border's costs are never read) */
+      next = c + offset[RIGHT];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, W)));
+      next = c + offset[LEFT];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, W)));
+      next = c + offset[DOWN_LEFT];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, W)));
+      next = c + offset[DOWN];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, W)));
     }  
   }
 
   for(int j = 0; j < game.dimension; j++)
-    hexes_needed_for_white = min(hexes_needed_for_white, cost_matrix[game.dimension-1][j]);
+    hexes_needed_for_white = min(hexes_needed_for_white, cost_matrix[cell_of(game.dimension-1, j)]);
 
   init_cost_matrix(cost_matrix, B);
 
   /* Compute the hexes needed for the black player to win (conducts a left-to-right BFS search) */
   for(int j = 0; j < game.dimension; j++) {
     for(int i = 0; i < game.dimension; i++) {
-      if(game.grid[i][j] == 'w') continue; /* 'w' -> anything : infinite cost (for the B player), so skip 'w' */
-
-      /* Up Neighbour */
-      if((trans_cost = transition_cost(i-1, j, B)) != -1)
-        cost_matrix[i-1][j] = min(cost_matrix[i-1][j], add(cost_matrix[i][j],trans_cost));
-      
-      /* Down Neighbour */
-      if((trans_cost = transition_cost(i+1, j, B)) != -1)
-        cost_matrix[i+1][j] = min(cost_matrix[i+1][j], add(cost_matrix[i][j],trans_cost));
-      
-      /* Right Neighbour */
-      if((trans_cost = transition_cost(i, j+1, B)) != -1)
-        cost_matrix[i][j+1] = min(cost_matrix[i][j+1], add(cost_matrix[i][j],trans_cost));
-      
-      /* Up-Right Neighbour */
-      if((trans_cost = transition_cost(i-1, j+1, B)) != -1)
-        cost_matrix[i-1][j+1] = min(cost_matrix[i-1][j+1], add(cost_matrix[i][j],trans_cost));
+      c = cell_of(i, j);
+      if(game.cells[c] == 'w') continue; /* 'w' -> anything : infinite cost (for the B player), so skip 'w' */
+
+      /* Up, Down, Right and Up-Right Neighbours */
+      next = c + offset[UP];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, B)));
+      next = c + offset[DOWN];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, B)));
+      next = c + offset[RIGHT];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, B)));
+      next = c + offset[UP_RIGHT];
+      cost_matrix[next] = min(cost_matrix[next], add(cost_matrix[c], transition_cost(next, B)));
     }  
   }
 
-  for(int i = 0; i < game.dimension; i++) {
-    hexes_needed_for_black = min(hexes_needed_for_black, cost_matrix[i][game.dimension-1]);
-    free(cost_matrix[i]); 
-  }
-  free(cost_matrix);
+  for(int i = 0; i < game.dimension; i++)
+    hexes_needed_for_black = min(hexes_needed_for_black, cost_matrix[cell_of(i, game.dimension-1)]);
 
   /* The evaluation returned is the <player>'s score for the given grid state */
   return (hexes_needed_for_black - hexes_needed_for_white) * ((player == W) ? 1 : -1);
@@ -192,23 +749,8 @@ int max_seq_length_difference(Colour player) {
   int white_max_len, black_max_len;
   char hex;
 
-  bool **visited; /* Marks the hexes that have been visited (needed for DFS) */
-
-  /* Allocate memory for visited */
-  if(!(visited = malloc(sizeof(bool *) * game.dimension))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-  for(int i = 0; i < game.dimension; i++)
-    if(!(visited[i] = malloc(sizeof(bool) * game.dimension))) {
-      print_error(MEMALLOC_ERROR);
-      exit(EXIT_FAILURE);
-    }
-
-  /* Initialize visited */
-  for(int i = 0; i < game.dimension; i++)
-    for(int j = 0; j < game.dimension; j++)
-      visited[i][j] = FALSE;
+  static _Thread_local bool visited[MAX_BORDERED_CELLS]; /* Marks the hexes that have been visited (needed for DFS) */
+  memset(visited, FALSE, sizeof(bool) * STRIDE(game.dimension)*STRIDE(game.dimension));
 
   black_max_len = white_max_len = 0;
 
@@ -218,8 +760,8 @@ int max_seq_length_difference(Colour player) {
       current_sequence_len = 0;
       hex = game.grid[row][col];
 
-      if(!visited[row][col] && hex != ' ') {
-        current_sequence_len = compute_sequence_length(row, col, hex, visited);
+      if(!visited[cell_of(row, col)] && hex != ' ') {
+        current_sequence_len = compute_sequence_length(cell_of(row, col), hex, visited);
         if(hex == 'b' && current_sequence_len > black_max_len)
           black_max_len = current_sequence_len;
         else if(hex == 'w' && current_sequence_len > white_max_len)
@@ -228,34 +770,26 @@ int max_seq_length_difference(Colour player) {
     }
   }
 
-  dealloc_bool(game.dimension, visited);
-
   /* The evaluation returned is the <player>'s score for the given grid state */
   return (white_max_len - black_max_len) * ((player == W) ? 1 : -1);
 }
 
-/* Explores the grid (DFS) and computes the length of a hex sequence */
-int compute_sequence_length(int row, int col, char hex, bool **visited) {
-  visited[row][col] = TRUE;
-
-  int sequence_len = 1; /* A hex forms a hex sequence of length 1 */
-  if(is_neighbour(row+1, col, hex) && !visited[row+1][col]) /* Down */
-    sequence_len += compute_sequence_length(row+1, col, hex, visited);
-
-  if(is_neighbour(row, col+1, hex) && !visited[row][col+1]) /* Right */
-    sequence_len += compute_sequence_length(row, col+1, hex, visited);
-
-  if(is_neighbour(row, col-1, hex) && !visited[row][col-1]) /* Left */
-    sequence_len += compute_sequence_length(row, col-1, hex, visited);
+/* The order in which the DFS searches visit a hex's neighbours */
+static const int dfs_order[DIRECTIONS] = {DOWN, RIGHT, LEFT, DOWN_LEFT, UP, UP_RIGHT};
 
-  if(is_neighbour(row+1, col-1, hex) && !visited[row+1][col-1]) /* Down-left */
-    sequence_len += compute_sequence_length(row+1, col-1, hex, visited);
+/* Explores the grid (DFS) and computes the length of a hex sequence (<cell> indexes game.cells, */
+/* whose border never matches <hex>) */
+int compute_sequence_length(int cell, char hex, bool *visited) {
+  const int *offset = neighbour[game.dimension];
+  visited[cell] = TRUE;
 
-  if(is_neighbour(row-1, col, hex) && !visited[row-1][col]) /* Up */
-    sequence_len += compute_sequence_length(row-1, col, hex, visited);
+  int sequence_len = 1; /* A hex forms a hex sequence of length 1 */
+  for(int d = 0; d < DIRECTIONS; d++) {
+    int next = cell + offset[dfs_order[d]];
 
-  if(is_neighbour(row-1, col+1, hex) && !visited[row-1][col+1]) /* Up-right */
-    sequence_len += compute_sequence_length(row-1, col+1, hex, visited);
+    if(game.cells[next] == hex && !visited[next])
+      sequence_len += compute_sequence_length(next, hex, visited);
+  }
 
   return sequence_len;
 }
@@ -267,30 +801,10 @@ bool game_finished(bool print_path, Colour player) {
   char hex = (player == W) ? 'w' : 'b';
   bool player_has_won = FALSE;
 
-  int *path, p_ind;
-  bool **visited; /* Marks the hexes that have been visited (needed for DFS) */
-
-  /* Allocate memory for visited */
-  if(!(visited = malloc(sizeof(bool *) * game.dimension))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-  for(int i=0; i < game.dimension; i++)
-    if(!(visited[i] = malloc(sizeof(bool) * game.dimension))) {
-      print_error(MEMALLOC_ERROR);
-      exit(EXIT_FAILURE);
-    }
-
-  /* Allocate memory for the path, which consists of at most (game.dimension^2)/2 hexes */
-  if(!(path = malloc(sizeof(int) * ((game.dimension*game.dimension)/2)))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-
-  /* Initialize visited */
-  for(int i=0; i < game.dimension; i++)
-    for(int j=0; j < game.dimension; j++)
-      visited[i][j] = FALSE;
+  int p_ind;
+  static _Thread_local int path[MAX_CELLS]; /* The winning path (a DFS chain never repeats a hex) */
+  static _Thread_local bool visited[MAX_BORDERED_CELLS]; /* Marks the hexes that have been visited (needed for DFS) */
+  memset(visited, FALSE, sizeof(bool) * STRIDE(game.dimension)*STRIDE(game.dimension));
 
   /* Check if opposite-side hexes are connected */
   for(starting_hex = 0; starting_hex < game.dimension; starting_hex++) {
@@ -299,58 +813,39 @@ bool game_finished(bool print_path, Colour player) {
     col = (starting_hex*step) % game.dimension;
 
     p_ind = 0;
-    if(game.grid[row][col] == hex && !visited[row][col]) {
-      if((player_has_won = evaluate_game(row, col, hex, visited, path, &p_ind))) {
+    if(game.grid[row][col] == hex && !visited[cell_of(row, col)]) {
+      if((player_has_won = evaluate_game(cell_of(row, col), hex, visited, path, &p_ind))) {
         if(print_path)
           print_winner(path, &p_ind);
 
-        free(path);
-        dealloc_bool(game.dimension, visited);
         return TRUE;
       }
     }
   }
 
-  free(path);
-  dealloc_bool(game.dimension, visited);
   return FALSE;
 }
 
-/* Explores the grid (DFS), in order to find if two opposing sides are connected */
-bool evaluate_game(int row, int col, char hex, bool **visited, int *path, int *p_ind) {
-  visited[row][col] = TRUE;
+/* Explores the grid (DFS), in order to find if two opposing sides are connected. The path */
+/* holds the hexes as row*game.dimension + col */
+bool evaluate_game(int cell, char hex, bool *visited, int *path, int *p_ind) {
+  const int *offset = neighbour[game.dimension];
+  visited[cell] = TRUE;
 
-  /* Check whether the current hex lies on a finishing side */
-  bool won = (hex == 'w' && row == game.dimension-1) ||
-             (hex == 'b' && col == game.dimension-1);
-
-  if(won)
-    path[(*p_ind)++] = row*game.dimension + col;
+  /* Check whether the current hex lies on a finishing side (next to the bottom or right border) */
+  bool won = (hex == 'w' && game.cells[cell + offset[DOWN]] == BORDER) ||
+             (hex == 'b' && game.cells[cell + offset[RIGHT]] == BORDER);
 
   /* Search for unvisited neighbouring hexes of the same colour */
-  if(!won && is_neighbour(row+1, col, hex) && !visited[row+1][col]) /* Down */
-    if((won = evaluate_game(row+1, col, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
+  for(int d = 0; !won && d < DIRECTIONS; d++) {
+    int next = cell + offset[dfs_order[d]];
 
-  if(!won && is_neighbour(row, col+1, hex) && !visited[row][col+1]) /* Right */
-    if((won = evaluate_game(row, col+1, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
-
-  if(!won && is_neighbour(row, col-1, hex) && !visited[row][col-1]) /* Left */
-    if((won = evaluate_game(row, col-1, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
-
-  if(!won && is_neighbour(row+1, col-1, hex) && !visited[row+1][col-1]) /* Down-left */
-    if((won = evaluate_game(row+1, col-1, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
-
-  if(!won && is_neighbour(row-1, col, hex) && !visited[row-1][col]) /* Up */
-    if((won = evaluate_game(row-1, col, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
+    if(game.cells[next] == hex && !visited[next])
+      won = evaluate_game(next, hex, visited, path, p_ind);
+  }
 
-  if(!won && is_neighbour(row-1, col+1, hex) && !visited[row-1][col+1]) /* Up-right */
-    if((won = evaluate_game(row-1, col+1, hex, visited, path, p_ind)))
-      path[(*p_ind)++] = row*game.dimension + col;
+  if(won)
+    path[(*p_ind)++] = cell_row(cell)*game.dimension + cell_col(cell);
 
   return won;
 }
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NN_X86
+#endif
+
+#include "hex.h"
+#include "network.h"
+
+nn_network *network = NULL;
+
+/* Computes the accumulators of every output channel for a single cell. <in> points to */
+/* the cell's input activations and offsets[t] is the byte offset of the t-th tap */
+typedef void (*conv_kernel)(const uint8_t *, const ptrdiff_t *, const int8_t *, const int32_t *, int, int32_t *);
+
+static void conv_cell_scalar(const uint8_t *in, const ptrdiff_t *offsets, const int8_t *weights,
+                             const int32_t *bias, int channels, int32_t *acc) {
+  memcpy(acc, bias, sizeof(int32_t) * channels);
+
+  for(int t = 0; t < NN_TAPS; t++) {
+    const uint8_t *src = in + offsets[t];
+
+    for(int g = 0; g < channels/4; g++, src += 4, weights += 4*channels) {
+      if(!(src[0] | src[1] | src[2] | src[3])) /* Sparse inputs (eg. the input planes) are skipped */
+        continue;
+
+      for(int o = 0; o < channels; o++)
+        acc[o] += src[0]*weights[4*o]   + src[1]*weights[4*o+1]
+                + src[2]*weights[4*o+2] + src[3]*weights[4*o+3];
+    }
+  }
+}
+
+#ifdef NN_X86
+/* 4 input channels are broadcast to every lane, and each lane multiplies them by the */
+/* weights of one output channel: maddubs sums pairs into 16 bits (at most 2*127*127, */
+/* so it never saturates) and madd with ones sums those pairs into 32 bits */
+__attribute__((target("avx2")))
+static void conv_cell_avx2(const uint8_t *in, const ptrdiff_t *offsets, const int8_t *weights,
+                           const int32_t *bias, int channels, int32_t *acc) {
+  __m256i sums[NN_MAX_CHANNELS/8];
+  const __m256i ones = _mm256_set1_epi16(1);
+  int quads = channels/8;
+
+  for(int q = 0; q < quads; q++)
+    sums[q] = _mm256_loadu_si256((const __m256i *) (bias + 8*q));
+
+  for(int t = 0; t < NN_TAPS; t++) {
+    const uint8_t *src = in + offsets[t];
+
+    for(int g = 0; g < channels/4; g++, src += 4, weights += 4*channels) {
+      int32_t group;
+      memcpy(&group, src, sizeof(group));
+      if(!group)
+        continue;
+
+      __m256i input = _mm256_set1_epi32(group);
+      for(int q = 0; q < quads; q++) {
+        __m256i w = _mm256_loadu_si256((const __m256i *) (weights + 32*q));
+        sums[q] = _mm256_add_epi32(sums[q], _mm256_madd_epi16(_mm256_maddubs_epi16(input, w), ones));
+      }
+    }
+  }
+
+  for(int q = 0; q < quads; q++)
+    _mm256_storeu_si256((__m256i *) (acc + 8*q), sums[q]);
+}
+
+/* Same as conv_cell_avx2(), with 4 output channels per register */
+__attribute__((target("ssse3")))
+static void conv_cell_ssse3(const uint8_t *in, const ptrdiff_t *offsets, const int8_t *weights,
+                            const int32_t *bias, int channels, int32_t *acc) {
+  __m128i sums[NN_MAX_CHANNELS/4];
+  const __m128i ones = _mm_set1_epi16(1);
+  int quads = channels/4;
+
+  for(int q = 0; q < quads; q++)
+    sums[q] = _mm_loadu_si128((const __m128i *) (bias + 4*q));
+
+  for(int t = 0; t < NN_TAPS; t++) {
+    const uint8_t *src = in + offsets[t];
+
+    for(int g = 0; g < channels/4; g++, src += 4, weights += 4*channels) {
+      int32_t group;
+      memcpy(&group, src, sizeof(group));
+      if(!group)
+        continue;
+
+      __m128i input = _mm_set1_epi32(group);
+      for(int q = 0; q < quads; q++) {
+        __m128i w = _mm_loadu_si128((const __m128i *) (weights + 16*q));
+        sums[q] = _mm_add_epi32(sums[q], _mm_madd_epi16(_mm_maddubs_epi16(input, w), ones));
+      }
+    }
+  }
+
+  for(int q = 0; q < quads; q++)
+    _mm_storeu_si128((__m128i *) (acc + 4*q), sums[q]);
+}
+#endif
+
+static const struct {
+  const char *name;
+  conv_kernel kernel;
+} kernels[] = {
+#ifdef NN_X86
+  {"avx2", conv_cell_avx2},
+  {"ssse3", conv_cell_ssse3},
+#endif
+  {"scalar", conv_cell_scalar}
+};
+
+static int kernel_ind = -1; /* Index of the selected kernel (-1 until one is selected) */
+
+static bool kernel_supported(const char *name) {
+#ifdef NN_X86
+  __builtin_cpu_init();
+  if(!strcmp(name, "avx2"))
+    return __builtin_cpu_supports("avx2");
+  if(!strcmp(name, "ssse3"))
+    return __builtin_cpu_supports("ssse3");
+#endif
+  return !strcmp(name, "scalar");
+}
+
+/* Selects a kernel by name, or the fastest one this CPU supports if <name> is NULL */
+bool nn_select_kernel(const char *name) {
+  int kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+
+  for(int k = 0; k < kernel_count; k++)
+    if((!name || !strcmp(name, kernels[k].name)) && kernel_supported(kernels[k].name)) {
+      kernel_ind = k;
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+const char *nn_kernel_name(void) {
+  if(kernel_ind < 0)
+    nn_select_kernel(NULL);
+
+  return kernels[kernel_ind].name;
+}
+
+size_t nn_file_size(int channels, int blocks) {
+  size_t conv_size = NN_TAPS*channels*channels + sizeof(int32_t)*channels;
+  size_t head_size = channels + sizeof(int32_t)*8;
+
+  return sizeof(nn_header) + (1 + 2*blocks)*conv_size + 2*head_size;
+}
+
+nn_network *nn_load(const char *filename) {
+  nn_network *net;
+  nn_header header;
+  struct stat st;
+  int fd;
+
+  if((fd = open(filename, O_RDONLY)) < 0)
+    return NULL;
+
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(header)
+     || read(fd, &header, sizeof(header)) != sizeof(header)
+     || memcmp(header.magic, NN_MAGIC, 4) || header.version != NN_VERSION
+     || !header.channels || header.channels % NN_CHANNEL_ALIGN || header.channels > NN_MAX_CHANNELS
+     || header.blocks > 64 || header.shift > 31 || header.value_shift > 31
+     || (size_t) st.st_size != nn_file_size(header.channels, header.blocks)) {
+    close(fd);
+    return NULL;
+  }
+
+  if(!(net = malloc(sizeof(nn_network)))) {
+    close(fd);
+    return NULL;
+  }
+
+  /* The mapping is shared, so concurrent processes keep a single copy of the weights in memory */
+  net->map_size = st.st_size;
+  net->map = mmap(NULL, net->map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(net->map == MAP_FAILED || !(net->convs = malloc(sizeof(nn_conv) * (1 + 2*header.blocks)))) {
+    if(net->map != MAP_FAILED)
+      munmap(net->map, net->map_size);
+    free(net);
+    return NULL;
+  }
+
+  net->digest = 0xCBF29CE484222325ULL;
+  for(size_t k = 0; k < net->map_size; k++)
+    net->digest = (net->digest ^ ((const unsigned char *) net->map)[k]) * 0x100000001B3ULL;
+
+  net->channels = header.channels;
+  net->blocks = header.blocks;
+  net->shift = header.shift;
+  net->value_shift = header.value_shift;
+
+  const char *section = (const char *) net->map + sizeof(nn_header);
+  for(int l = 0; l < 1 + 2*net->blocks; l++) {
+    net->convs[l].weights = (const int8_t *) section;
+    section += NN_TAPS*net->channels*net->channels;
+    net->convs[l].bias = (const int32_t *) section;
+    section += sizeof(int32_t)*net->channels;
+  }
+
+  net->policy_weights = (const int8_t *) section;
+  section += net->channels;
+  net->policy_bias = *(const int32_t *) section;
+  section += sizeof(int32_t)*8;
+
+  net->value_weights = (const int8_t *) section;
+  section += net->channels;
+  net->value_bias = *(const int32_t *) section;
+
+  if(kernel_ind < 0)
+    nn_select_kernel(NULL);
+
+  return net;
+}
+
+void nn_free(nn_network *net) {
+  if(!net)
+    return;
+
+  munmap(net->map, net->map_size);
+  free(net->convs);
+  free(net);
+}
+
+/* Applies a convolution to every cell of a (padded) grid, adding <residual> if it isn't NULL */
+static void convolve(const nn_network *net, const nn_conv *conv, int dimension,
+                     const uint8_t *in, uint8_t *out, const uint8_t *residual) {
+  int C = net->channels, width = dimension+2;
+  int32_t acc[NN_MAX_CHANNELS];
+
+  /* Taps, in (row, col) offsets: up, up-right, left, centre, right, down-left, down */
+  ptrdiff_t offsets[NN_TAPS] = {
+    -width*C, (-width+1)*C, -C, 0, C, (width-1)*C, width*C
+  };
+
+  for(int i = 1; i <= dimension; i++)
+    for(int j = 1; j <= dimension; j++) {
+      int cell = (i*width + j)*C;
+
+      kernels[kernel_ind].kernel(in + cell, offsets, conv->weights, conv->bias, C, acc);
+      for(int o = 0; o < C; o++) {
+        int32_t a = (acc[o] >> net->shift) + (residual ? residual[cell+o] : 0);
+        out[cell+o] = (a < 0) ? 0 : (a > 127) ? 127 : a;
+      }
+    }
+}
+
+/* Each thread keeps its planes from one evaluation to the next, so that the search's evaluations, */
+/* one position at a time, neither allocate nor clear them. They're laid out for <planes_count> */
+/* grids of <planes_dimension> with <planes_channels> channels: their padding (which the */
+/* convolutions read but never write) is only set when that layout changes. The key frees a */
+/* thread's planes when it exits */
+static _Thread_local uint8_t *planes;
+static _Thread_local size_t planes_size;
+static _Thread_local int planes_count, planes_dimension, planes_channels;
+static pthread_key_t planes_key;
+static pthread_once_t planes_once = PTHREAD_ONCE_INIT;
+
+static void create_planes_key(void) {
+  pthread_key_create(&planes_key, free);
+}
+
+bool nn_evaluate_batch(const nn_network *net, int count, char ***grids, int dimension, int *values, int *policy) {
+  int C = net->channels, width = dimension+2, cells = dimension*dimension;
+  size_t plane_size = (size_t) width*width*C, size = 3*plane_size*count;
+  uint8_t *input, *x, *h;
+
+  /* Each position needs three planes: the input, the residual stream (x) and the block's hidden layer (h) */
+  if(size > planes_size) {
+    uint8_t *grown = malloc(size);
+
+    if(!grown)
+      return FALSE;
+    pthread_once(&planes_once, create_planes_key);
+    pthread_setspecific(planes_key, grown);
+    free(planes);
+    planes = grown;
+    planes_size = size;
+    planes_count = 0;
+  }
+  input = planes;
+  x = input + plane_size*count;
+  h = x + plane_size*count;
+
+  if(count != planes_count || dimension != planes_dimension || C != planes_channels) {
+    memset(planes, 0, size); /* The padding is read as zeros .. */
+
+    /* .. except in the input, whose padding rows count as white stones and padding columns as black ones */
+    for(int p = 0; p < count; p++)
+      for(int k = 1; k <= dimension; k++) {
+        uint8_t *in = input + p*plane_size;
+
+        in[k*C] = in[((dimension+1)*width + k)*C] = NN_ONE;
+        in[(k*width)*C + 1] = in[(k*width + dimension+1)*C + 1] = NN_ONE;
+      }
+
+    planes_count = count;
+    planes_dimension = dimension;
+    planes_channels = C;
+  }
+
+  for(int p = 0; p < count; p++) {
+    uint8_t *in = input + p*plane_size;
+
+    int stone_balance = 0; /* White's stones minus Black's */
+    for(int i = 0; i < dimension; i++) {
+      memset(in + ((i+1)*width + 1)*C, 0, (size_t) dimension*C);
+      for(int j = 0; j < dimension; j++) {
+        char hex = grids[p][i][j];
+        in[((i+1)*width + j+1)*C + ((hex == 'w') ? 0 : (hex == 'b') ? 1 : 2)] = NN_ONE;
+        stone_balance += (hex == 'w') - (hex == 'b');
+      }
+    }
+
+    if(stone_balance <= 0) /* White is to move */
+      for(int i = 1; i <= dimension; i++)
+        for(int j = 1; j <= dimension; j++)
+          in[(i*width + j)*C + 3] = NN_ONE;
+  }
+
+  /* The batch is evaluated layer by layer, so that each layer's weights stay in cache for all of its positions */
+  for(int p = 0; p < count; p++)
+    convolve(net, &net->convs[0], dimension, input + p*plane_size, x + p*plane_size, NULL);
+
+  for(int b = 0; b < net->blocks; b++) {
+    for(int p = 0; p < count; p++)
+      convolve(net, &net->convs[1 + 2*b], dimension, x + p*plane_size, h + p*plane_size, NULL);
+
+    /* In place: each cell only reads its own residual */
+    for(int p = 0; p < count; p++)
+      convolve(net, &net->convs[2 + 2*b], dimension, h + p*plane_size, x + p*plane_size, x + p*plane_size);
+  }
+
+  for(int p = 0; p < count; p++) {
+    const uint8_t *out = x + p*plane_size;
+
+    /* Value head: average pooling followed by a linear layer */
+    int64_t value = 0;
+    for(int o = 0; o < C; o++) {
+      int32_t sum = 0;
+      for(int i = 1; i <= dimension; i++)
+        for(int j = 1; j <= dimension; j++)
+          sum += out[(i*width + j)*C + o];
+      value += (int64_t) (sum / cells) * net->value_weights[o];
+    }
+    value = (value + net->value_bias) >> net->value_shift;
+    values[p] = (value < -NN_VALUE_MAX) ? -NN_VALUE_MAX : (value > NN_VALUE_MAX) ? NN_VALUE_MAX : value;
+
+    /* Policy head: a 1x1 convolution producing one logit per cell */
+    if(policy)
+      for(int i = 0; i < dimension; i++)
+        for(int j = 0; j < dimension; j++) {
+          const uint8_t *act = out + ((i+1)*width + j+1)*C;
+          int32_t logit = net->policy_bias;
+
+          for(int o = 0; o < C; o++)
+            logit += act[o] * net->policy_weights[o];
+          policy[p*cells + i*dimension + j] = logit;
+        }
+  }
+
+  return TRUE;
+}
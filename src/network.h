@@ -0,0 +1,75 @@
+/* A small residual convolutional network, evaluated with int8 arithmetic.
+ *
+ * The grid is padded by one cell on each side. Hex adjacency maps to a 3x3
+ * kernel with the (-1,-1) and (+1,+1) corners masked out, so every
+ * convolution has NN_TAPS taps. Input planes (channels 0..3) mark white
+ * stones, black stones, empty cells and (on every cell) whether White is to
+ * move. The padding rows above and below the grid count as white stones and
+ * the padding columns as black ones, so the network sees which edges each
+ * player has to connect. The value is White's evaluation and the policy
+ * ranks the moves of the player to move.
+ *
+ * Weights file layout (little-endian, every section a multiple of 32 bytes):
+ *   nn_header
+ *   1 + 2*blocks convolutions, each:
+ *     int8  weights[NN_TAPS][channels/4][channels][4] (tap, input group, output, input within group)
+ *     int32 bias[channels]
+ *   policy head: int8 weights[channels], int32 bias[8] (only bias[0] is used)
+ *   value head:  int8 weights[channels], int32 bias[8] (only bias[0] is used)
+ *
+ * Activations are unsigned 8-bit in [0,127], where NN_ONE represents 1.0.
+ */
+
+#define NN_MAGIC "HXNN"
+#define NN_VERSION 1
+
+#define NN_TAPS 7
+#define NN_ONE 64
+#define NN_CHANNEL_ALIGN 32 /* The channel count must be a multiple of this */
+#define NN_MAX_CHANNELS 256
+#define NN_VALUE_MAX 10000 /* Network values are clamped to [-NN_VALUE_MAX, NN_VALUE_MAX] */
+
+#define NN_MAX_BATCH 32
+
+typedef struct nn_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t channels;
+  uint32_t blocks; /* Number of residual blocks (two convolutions each) */
+  uint32_t shift; /* Right shift applied to convolution sums */
+  uint32_t value_shift; /* Right shift applied to the value head's sum */
+  uint32_t reserved[2];
+} nn_header;
+
+typedef struct nn_conv {
+  const int8_t *weights;
+  const int32_t *bias;
+} nn_conv;
+
+typedef struct nn_network {
+  void *map; /* The memory-mapped weights file */
+  size_t map_size;
+  uint64_t digest; /* Hash (FNV-1a) of the file, which tells networks apart */
+
+  int channels, blocks, shift, value_shift;
+  nn_conv *convs; /* 1 + 2*blocks convolutions */
+  const int8_t *policy_weights, *value_weights;
+  int32_t policy_bias, value_bias;
+} nn_network;
+
+/* The network used by static_evaluate() and minimax()'s move ordering (NULL if none is loaded) */
+extern nn_network *network;
+
+nn_network *nn_load(const char *); /* Maps a weights file, returning NULL if it's invalid */
+void nn_free(nn_network *);
+size_t nn_file_size(int, int); /* Size of a weights file with the given channels and blocks */
+
+/* Evaluates <count> grids of the given dimension. values[i] receives White's */
+/* evaluation of grids[i] and, if <policy> isn't NULL, policy[i*dimension^2 + cell] */
+/* receives the move prior (logit) of each cell for the player to move. White is */
+/* to move when it doesn't have more stones than Black (this also holds after a swap). */
+/* Returns FALSE if the batch's planes couldn't be allocated */
+bool nn_evaluate_batch(const nn_network *, int, char ***, int, int *, int *);
+
+bool nn_select_kernel(const char *); /* Selects a kernel ("avx2", "ssse3", "scalar") or, given NULL, the fastest one available */
+const char *nn_kernel_name(void); /* Name of the selected convolution kernel */
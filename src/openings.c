@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex.h"
+#include "directives.h"
+#include "openings.h"
+
+/* The loaded file, and each grid size's values in it (NULL for sizes it has no table for) */
+static char *file_data = NULL;
+static const int16_t *values[MAX_DIMENSION+1];
+
+bool openings_open(char *filename) {
+  FILE *file;
+  long size;
+
+  if(!(file = fopen(filename, "rb")))
+    return FALSE;
+
+  /* The file is small (2 bytes per cell of each grid size), so it's read whole */
+  if(fseek(file, 0, SEEK_END) || (size = ftell(file)) < (long) sizeof(ob_header) || fseek(file, 0, SEEK_SET)) {
+    fclose(file);
+    return FALSE;
+  }
+
+  if(!(file_data = malloc(size))) {
+    fclose(file);
+    return FALSE;
+  }
+
+  size_t count = fread(file_data, 1, size, file);
+  fclose(file);
+
+  const ob_header *header = (const ob_header *) file_data;
+  if(count != (size_t) size || memcmp(header->magic, OB_MAGIC, 4) || header->version != OB_VERSION
+     || header->table_count > OB_MAX_TABLES || (size_t) size < sizeof(ob_header) + header->table_count*sizeof(ob_table)) {
+    openings_close();
+    return FALSE;
+  }
+
+  /* Every table must lie inside the file */
+  const ob_table *tables = (const ob_table *) (file_data + sizeof(ob_header));
+  for(uint32_t t = 0; t < header->table_count; t++) {
+    uint32_t n = tables[t].dimension;
+
+    if(n < MIN_DIMENSION || n > MAX_DIMENSION || tables[t].offset % sizeof(int16_t)
+       || tables[t].offset > (uint64_t) size || n*n > (size - tables[t].offset) / sizeof(int16_t)) {
+      openings_close();
+      return FALSE;
+    }
+    values[n] = (const int16_t *) (file_data + tables[t].offset);
+  }
+
+  return TRUE;
+}
+
+void openings_close(void) {
+  free(file_data);
+  file_data = NULL;
+  memset(values, 0, sizeof(values));
+}
+
+/* The second player swaps when the first move is worth more to its owner than the move they'd */
+/* get instead. Without a table for the grid, they never do */
+bool opening_swap(void) {
+  const int16_t *value = values[game.dimension];
+
+  return value && engine->history.ply && value[engine->history.moves[0].row*game.dimension + engine->history.moves[0].col] > 0;
+}
+
+/* Whichever move is played, the opponent keeps the better side of it, swapping or not: the first */
+/* player can only make sure that side isn't much better than the other. The table only applies */
+/* to an empty grid (not, say, to a loaded position) */
+bool opening_move(Move *move) {
+  const int16_t *value = values[game.dimension];
+  int best = -1;
+
+  if(!value)
+    return FALSE;
+
+  for(int c = 0; c < game.dimension*game.dimension; c++) {
+    if(game.grid[c / game.dimension][c % game.dimension] != ' ')
+      return FALSE;
+    if(best < 0 || abs(value[c]) < abs(value[best]))
+      best = c;
+  }
+
+  move->row = best / game.dimension;
+  move->col = best % game.dimension;
+  return TRUE;
+}
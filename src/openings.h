@@ -0,0 +1,33 @@
+/* First-move table: the value of every opening move, per grid size, built offline by hexopen.
+ *
+ * A move's value is White's score once it's been played (Black to move): positive if the move
+ * favours the player who made it, OB_WIN / -OB_WIN if it's been solved. Under the swap rule the
+ * second player takes over any move worth more than 0, so the first player's best opening is
+ * the one whose value is closest to 0. Layout (little-endian):
+ *   ob_header
+ *   ob_header.table_count ob_table entries
+ *   the tables' values, each one an int16, row by row
+ */
+
+#define OB_MAGIC "HXOB"
+#define OB_VERSION 1
+#define OB_MAX_TABLES (MAX_DIMENSION - MIN_DIMENSION + 1)
+#define OB_WIN 32767
+
+typedef struct ob_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t table_count;
+  uint32_t reserved;
+} ob_header;
+
+typedef struct ob_table {
+  uint32_t dimension;
+  uint32_t reserved;
+  uint64_t offset; /* Byte offset of the first value, from the start of the file */
+} ob_table;
+
+bool openings_open(char *); /* Loads a first-move table file, returning FALSE if it's invalid */
+void openings_close(void);
+bool opening_swap(void); /* Whether the second player should take over the first move */
+bool opening_move(Move *); /* The first move least worth swapping (FALSE if there's no table for the grid) */
@@ -0,0 +1,29 @@
+/* Local patterns: the state of an empty cell's 6 neighbours, as an index into precomputed tables.
+ *
+ * The neighbours are taken in ring order (each one adjacent to the next), starting above the cell:
+ *   (row-1, col), (row-1, col+1), (row, col+1), (row+1, col), (row+1, col-1), (row, col-1)
+ * and neighbour d takes bits 2d and 2d+1 of the index: PT_EMPTY, PT_WHITE or PT_BLACK. Cells off
+ * the grid count as stones of the edge's owner (the top and bottom edges are White's, the left and
+ * right ones Black's).
+ *
+ * The tables are generated by patterns_gen (a build step, see the Makefile) into patterns.c.
+ */
+
+#define PT_NEIGHBOURS 6
+#define PT_INDICES (1 << 2*PT_NEIGHBOURS)
+
+#define PT_EMPTY 0
+#define PT_WHITE 1
+#define PT_BLACK 2
+
+/* Flags of an empty cell, given its neighbourhood */
+#define PT_CAPTURED_W 0x01 /* Useless to Black: White may treat it as its own, and Black never needs to play it */
+#define PT_CAPTURED_B 0x02 /* Useless to White */
+#define PT_DEAD       (PT_CAPTURED_W | PT_CAPTURED_B) /* Useless to both */
+#define PT_SAVE_W     0x04 /* Reconnects two white stones whose bridge Black has intruded into */
+#define PT_SAVE_B     0x08
+
+#define PT_CAPTURED(colour) ((colour) == W ? PT_CAPTURED_W : PT_CAPTURED_B)
+
+extern const unsigned char pattern_flags[PT_INDICES];
+extern const unsigned char pattern_prior[2][PT_INDICES]; /* Move-ordering priors, by the mover's colour (B, W) */
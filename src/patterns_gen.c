@@ -0,0 +1,105 @@
+/* patterns_gen: writes the local-pattern tables of patterns.h (as C source) to stdout
+ *
+ * A cell is useless to a player if a stone of theirs there never connects anything their
+ * neighbouring stones don't already connect: any two neighbours they could pass through are
+ * adjacent, or joined by an arc of the ring made of their stones only. A winning path through the
+ * cell can then always go around it, so playing there is no better than passing.
+ */
+
+#include <stdio.h>
+
+#include "hex.h"
+#include "patterns.h"
+
+#define state(index, d) (((index) >> 2*((d) % PT_NEIGHBOURS)) & 3)
+
+/* Checks whether the neighbours <a> and <b> are joined by one of the ring's arcs whose inner */
+/* cells all hold <stone> */
+static bool joined(int index, int a, int b, int stone) {
+  for(int dir = 1; dir < PT_NEIGHBOURS; dir += PT_NEIGHBOURS-2) { /* Clockwise, then anticlockwise */
+    int d = (a + dir) % PT_NEIGHBOURS;
+
+    while(d != b && state(index, d) == stone)
+      d = (d + dir) % PT_NEIGHBOURS;
+    if(d == b)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static bool useless(int index, int stone) {
+  for(int a = 0; a < PT_NEIGHBOURS; a++)
+    for(int b = a+1; b < PT_NEIGHBOURS; b++) {
+      int sa = state(index, a), sb = state(index, b);
+
+      if((sa == PT_EMPTY || sa == stone) && (sb == PT_EMPTY || sb == stone) && !joined(index, a, b, stone))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Checks whether two of <stone>'s neighbours form a bridge, with the opponent in its other */
+/* carrier cell, that the cell would reconnect (unless the other side of the ring already does) */
+static bool saves_bridge(int index, int stone) {
+  for(int d = 0; d < PT_NEIGHBOURS; d++)
+    if(state(index, d) == stone && state(index, d+2) == stone && state(index, d+1) == PT_WHITE + PT_BLACK - stone
+       && !(state(index, d+3) == stone && state(index, d+4) == stone && state(index, d+5) == stone))
+      return TRUE;
+
+  return FALSE;
+}
+
+int main(void) {
+  static unsigned char flags[PT_INDICES], prior[2][PT_INDICES];
+
+  for(int index = 0; index < PT_INDICES; index++) {
+    bool valid = TRUE;
+    int stones = 0;
+
+    for(int d = 0; d < PT_NEIGHBOURS; d++) {
+      valid &= state(index, d) != 3;
+      stones += state(index, d) != PT_EMPTY;
+    }
+    if(!valid)
+      continue;
+
+    if(useless(index, PT_BLACK))
+      flags[index] |= PT_CAPTURED_W;
+    if(useless(index, PT_WHITE))
+      flags[index] |= PT_CAPTURED_B;
+    if(saves_bridge(index, PT_WHITE))
+      flags[index] |= PT_SAVE_W;
+    if(saves_bridge(index, PT_BLACK))
+      flags[index] |= PT_SAVE_B;
+
+    /* Saving one's own bridge comes first, then cutting the opponent's, then contact moves */
+    for(Colour mover = B; mover <= W; mover++) {
+      int own = (mover == W) ? PT_SAVE_W : PT_SAVE_B, other = (mover == W) ? PT_SAVE_B : PT_SAVE_W;
+
+      if(flags[index] & PT_CAPTURED(!mover))
+        prior[mover][index] = 0;
+      else
+        prior[mover][index] = 1 + stones + ((flags[index] & own) ? 40 : 0) + ((flags[index] & other) ? 20 : 0);
+    }
+  }
+
+  printf("/* Generated by patterns_gen: do not edit */\n\n#include \"patterns.h\"\n");
+
+  printf("\nconst unsigned char pattern_flags[PT_INDICES] = {");
+  for(int index = 0; index < PT_INDICES; index++)
+    printf("%s%d,", (index % 32) ? "" : "\n  ", flags[index]);
+  printf("\n};\n");
+
+  printf("\nconst unsigned char pattern_prior[2][PT_INDICES] = {");
+  for(int mover = 0; mover < 2; mover++) {
+    printf("\n {");
+    for(int index = 0; index < PT_INDICES; index++)
+      printf("%s%d,", (index % 32) ? "" : "\n  ", prior[mover][index]);
+    printf("\n },");
+  }
+  printf("\n};\n");
+
+  return 0;
+}
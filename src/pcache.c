@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "evaluate.h"
+#include "network.h"
+#include "pcache.h"
+
+static void *map = NULL;
+static size_t map_size;
+static pc_slot *slots;
+static uint64_t bucket_mask;
+
+bool pcache_open(char *filename) {
+  pc_header header;
+  struct stat st;
+  int fd;
+
+  if((fd = open(filename, O_RDWR | O_CREAT, 0644)) < 0)
+    return FALSE;
+
+  /* Concurrent processes may all try to create the file: the lock lets exactly one of them do it */
+  flock(fd, LOCK_EX);
+  if(fstat(fd, &st) < 0) {
+    close(fd);
+    return FALSE;
+  }
+
+  if(st.st_size == 0) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PC_MAGIC, 4);
+    header.version = PC_VERSION;
+    header.bucket_count = ((uint64_t) PC_DEFAULT_MB << 20) / (PC_BUCKET*sizeof(pc_slot));
+
+    /* ftruncate() zero-fills the slots, which marks them as empty */
+    if(ftruncate(fd, sizeof(header) + header.bucket_count*PC_BUCKET*sizeof(pc_slot)) < 0
+       || pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      close(fd);
+      return FALSE;
+    }
+    st.st_size = sizeof(header) + header.bucket_count*PC_BUCKET*sizeof(pc_slot);
+  }
+  else if(pread(fd, &header, sizeof(header), 0) != sizeof(header)
+          || memcmp(header.magic, PC_MAGIC, 4) || header.version != PC_VERSION
+          || !header.bucket_count || (header.bucket_count & (header.bucket_count-1))
+          || (uint64_t) st.st_size != sizeof(header) + header.bucket_count*PC_BUCKET*sizeof(pc_slot)) {
+    close(fd);
+    return FALSE;
+  }
+  flock(fd, LOCK_UN);
+
+  map_size = st.st_size;
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(map == MAP_FAILED) {
+    map = NULL;
+    return FALSE;
+  }
+
+  slots = (pc_slot *) ((char *) map + sizeof(header));
+  bucket_mask = header.bucket_count - 1;
+  return TRUE;
+}
+
+void pcache_close(void) {
+  if(map)
+    munmap(map, map_size);
+  map = NULL;
+}
+
+/* Mixes the evaluator into the position's Zobrist key, since results searched with different */
+/* networks or weights aren't interchangeable: the network's digest if one is loaded, or else */
+/* the weights of the heuristic features */
+uint64_t pcache_key(int *transform) {
+  uint64_t key = canonical_key(TRUE, transform);
+  const unsigned char *bytes = (const unsigned char *) eval_weights;
+
+  if(network)
+    key = (key ^ network->digest) * 0x100000001B3ULL;
+  else
+    for(size_t k = 0; k < sizeof(eval_weights); k++)
+      key = (key ^ bytes[k]) * 0x100000001B3ULL;
+
+  return key;
+}
+
+static int slot_depth(uint64_t data) {
+  return (data >> 48) & 0xFF;
+}
+
+bool pcache_probe(uint64_t key, int transform, int depth, Move *move, int *score) {
+  if(!map)
+    return FALSE;
+
+  pc_slot *bucket = slots + (key & bucket_mask)*PC_BUCKET;
+  for(int s = 0; s < PC_BUCKET; s++) {
+    uint64_t check = __atomic_load_n(&bucket[s].check, __ATOMIC_ACQUIRE);
+    uint64_t data = __atomic_load_n(&bucket[s].data, __ATOMIC_ACQUIRE);
+
+    /* Proven results hold at any depth, deeper than PC_PROVEN plies too */
+    if((check ^ data) != key || !(data >> 56) || (slot_depth(data) < depth && slot_depth(data) != PC_PROVEN))
+      continue;
+
+    int cell = (data >> 32) & 0xFFFF;
+    move->row = cell / MAX_DIMENSION;
+    move->col = cell % MAX_DIMENSION;
+    transform_cell(transform, &move->row, &move->col);
+    *score = (int32_t) (uint32_t) data;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Stores a result, replacing the same position's shallower result or else the bucket's shallowest slot */
+void pcache_store(uint64_t key, int transform, int depth, Move *move, int score) {
+  if(!map)
+    return;
+
+  int row = move->row, col = move->col;
+  transform_cell(transform, &row, &col);
+
+  if(depth > PC_PROVEN)
+    depth = PC_PROVEN;
+
+  pc_slot *bucket = slots + (key & bucket_mask)*PC_BUCKET;
+  int victim = 0, victim_depth = PC_PROVEN+1;
+
+  for(int s = 0; s < PC_BUCKET; s++) {
+    uint64_t check = __atomic_load_n(&bucket[s].check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&bucket[s].data, __ATOMIC_RELAXED);
+    int s_depth = (data >> 56) ? slot_depth(data) : -1;
+
+    if((check ^ data) == key) {
+      if(s_depth > depth)
+        return; /* A deeper result is already cached */
+      victim = s;
+      break;
+    }
+    if(s_depth < victim_depth) {
+      victim = s;
+      victim_depth = s_depth;
+    }
+  }
+
+  uint64_t data = (uint32_t) score
+                | (uint64_t) (row*MAX_DIMENSION + col) << 32
+                | (uint64_t) depth << 48
+                | (uint64_t) 1 << 56;
+
+  __atomic_store_n(&bucket[victim].data, data, __ATOMIC_RELEASE);
+  __atomic_store_n(&bucket[victim].check, key ^ data, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,35 @@
+/* Persistent position cache: a memory-mapped file shared by every hex process on the host.
+ *
+ * Each slot holds a search result (best move, score, depth) for a position. Slots are
+ * written without locks: a slot stores its data word and (key ^ data), so a reader that
+ * sees a half-written slot (or one written concurrently by two processes) just misses.
+ * The file's size is fixed when it's created; old results are overwritten as it fills up.
+ */
+
+#define PC_MAGIC "HXPC"
+#define PC_VERSION 1
+#define PC_DEFAULT_MB 64 /* Size of newly created cache files */
+#define PC_BUCKET 4 /* Slots per bucket (one cache line), searched together */
+#define PC_PROVEN 255 /* Depth stored for proven results, which satisfy any search depth */
+
+typedef struct pc_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t bucket_count; /* A power of 2 */
+  uint64_t reserved[2];
+} pc_header;
+
+typedef struct pc_slot {
+  uint64_t check; /* key ^ data */
+  uint64_t data; /* score (bits 0-31), move cell (32-47), depth (48-55), valid flag (56) */
+} pc_slot;
+
+bool pcache_open(char *); /* Maps (creating it if needed) a cache file, returning FALSE on failure */
+void pcache_close(void);
+/* The current position's canonical key (which depends on the evaluator too) and its symmetry. */
+/* Moves are cached in the canonical position's frame, and mapped back through the symmetry */
+uint64_t pcache_key(int *);
+
+/* Looks up a result searched to at least <depth> plies; returns TRUE and fills in the move and score on a hit */
+bool pcache_probe(uint64_t, int, int, Move *, int *);
+void pcache_store(uint64_t, int, int, Move *, int);
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "positions.h"
+
+size_t pos_record_size(int dimension) {
+  return POS_RECORD_HEADER + (dimension*dimension + 3)/4;
+}
+
+/* Packs the current grid, together with its labels, into <record> */
+void pos_pack(uint8_t *record, int result, int score, int move) {
+  int cells = game.dimension*game.dimension;
+
+  record[0] = (uint8_t) (int8_t) result;
+  record[1] = 0;
+  record[2] = score & 0xFF;
+  record[3] = (score >> 8) & 0xFF;
+  record[4] = move & 0xFF;
+  record[5] = (move >> 8) & 0xFF;
+
+  memset(record + POS_RECORD_HEADER, 0, (cells + 3)/4);
+  for(int c = 0; c < cells; c++) {
+    char hex = game.grid[c / game.dimension][c % game.dimension];
+    record[POS_RECORD_HEADER + c/4] |= ((hex == 'w') ? 1 : (hex == 'b') ? 2 : 0) << (2*(c%4));
+  }
+}
+
+/* Replaces the stones of game.grid (which must have the record's dimension) with the record's */
+void pos_unpack(const uint8_t *record) {
+  int cells = game.dimension*game.dimension;
+
+  for(int c = 0; c < cells; c++) {
+    int code = (record[POS_RECORD_HEADER + c/4] >> (2*(c%4))) & 3;
+    set_hex(c / game.dimension, c % game.dimension, (code == 1) ? 'w' : (code == 2) ? 'b' : ' ');
+  }
+}
+
+bool pos_open(pos_file *file, char *filename) {
+  pos_header header;
+  struct stat st;
+  int fd;
+
+  if((fd = open(filename, O_RDONLY)) < 0)
+    return FALSE;
+
+  if(fstat(fd, &st) < 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+     || memcmp(header.magic, POS_MAGIC, 4) || header.version != POS_VERSION
+     || header.dimension < MIN_DIMENSION || header.dimension > MAX_DIMENSION) {
+    close(fd);
+    return FALSE;
+  }
+
+  file->dimension = header.dimension;
+  file->record_size = pos_record_size(header.dimension);
+
+  /* A partially written last record (eg. from an interrupted writer) is ignored */
+  file->count = (st.st_size - sizeof(header)) / file->record_size;
+
+  file->map_size = st.st_size;
+  file->map = mmap(NULL, file->map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(file->map == MAP_FAILED)
+    return FALSE;
+
+  madvise(file->map, file->map_size, MADV_SEQUENTIAL);
+  file->records = (const uint8_t *) file->map + sizeof(header);
+  return TRUE;
+}
+
+void pos_close(pos_file *file) {
+  munmap(file->map, file->map_size);
+}
+
+FILE *pos_create(char *filename, int dimension) {
+  pos_header header = {POS_MAGIC, POS_VERSION, dimension, 0};
+  FILE *file;
+
+  if(!(file = fopen(filename, "wb")))
+    return NULL;
+
+  fwrite(&header, sizeof(header), 1, file);
+  return file;
+}
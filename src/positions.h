@@ -0,0 +1,41 @@
+/* Position files hold labelled positions of a single grid size:
+ *   pos_header
+ *   records of pos_record_size(dimension) bytes (as many as the file holds), each:
+ *     int8   result  (+1: White won the game, -1: Black won)
+ *     uint8  flags   (reserved, 0)
+ *     int16  score   (White's search score, 0 if unknown)
+ *     uint16 move    (row*dimension + col of the move played next, POS_NO_MOVE if none)
+ *     uint8  cells[(dimension^2+3)/4]  (2 bits per cell, row-major: 0 empty, 1 white, 2 black)
+ * Multi-byte fields are little-endian.
+ */
+
+#define POS_MAGIC "HXPS"
+#define POS_VERSION 1
+#define POS_NO_MOVE 0xFFFF
+#define POS_RECORD_HEADER 6
+
+typedef struct pos_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t dimension;
+  uint32_t reserved;
+} pos_header;
+
+typedef struct pos_file {
+  void *map; /* The memory-mapped file */
+  size_t map_size;
+  int dimension;
+  size_t count, record_size;
+  const uint8_t *records;
+} pos_file;
+
+size_t pos_record_size(int);
+
+/* Packs the current game.grid into a record / unpacks a record into game.grid */
+void pos_pack(uint8_t *, int, int, int);
+void pos_unpack(const uint8_t *);
+
+bool pos_open(pos_file *, char *); /* Maps a position file for reading */
+void pos_close(pos_file *);
+
+FILE *pos_create(char *, int); /* Creates a position file, writing its header */
@@ -0,0 +1,230 @@
+/* A pool of threads time-slicing many libhex searches (see libhex.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "hex.h"
+#include "libhex.h"
+#include "directives.h"
+
+#define SLICE_NODES 2000 /* A search runs this many nodes before the next one is picked */
+
+typedef struct job_t {
+  hex_engine *engine;
+  hex_limits limits;
+  int weight; /* 0 for deadline jobs */
+  double deadline; /* Deadline jobs: when the search must end (wall time) */
+  double vruntime; /* Fair-share jobs: seconds run, divided by the weight */
+  bool started, running, stopped;
+  hex_done done;
+  void *data;
+} job_t;
+
+struct hex_scheduler {
+  pthread_mutex_t lock;
+  pthread_cond_t ready; /* A job may be waiting for a thread */
+  pthread_t *threads;
+  int thread_count;
+  bool closing;
+
+  job_t **jobs;
+  int job_count, job_size;
+  double min_vruntime; /* Where the fair-share jobs are (new ones start here) */
+};
+
+/* Picks the next job to run (called with the lock held): stopped jobs first, since they only */
+/* need to report, then the deadline job due first, then the fair-share job that got the least */
+/* time for its weight */
+static int pick(hex_scheduler *s) {
+  int next = -1;
+
+  for(int k = 0; k < s->job_count; k++) {
+    job_t *job = s->jobs[k], *other = (next >= 0) ? s->jobs[next] : NULL;
+
+    if(job->running)
+      continue;
+    if(!other || (job->stopped && !other->stopped))
+      next = k;
+    else if(job->stopped || other->stopped)
+      continue;
+    else if(!job->weight && (other->weight || job->deadline < other->deadline))
+      next = k;
+    else if(job->weight && other->weight && job->vruntime < other->vruntime)
+      next = k;
+  }
+
+  return next;
+}
+
+static void *worker(void *arg) {
+  hex_scheduler *s = arg;
+  hex_result result;
+
+  pthread_mutex_lock(&s->lock);
+  while(TRUE) {
+    int next = pick(s);
+
+    if(next < 0) {
+      if(s->closing && !s->job_count)
+        break;
+      pthread_cond_wait(&s->ready, &s->lock);
+      continue;
+    }
+
+    job_t *job = s->jobs[next];
+    bool finished = FALSE, stopped = job->stopped;
+
+    /* Node-limited searches aren't cut short, so that their results stay reproducible */
+    if(!job->weight && !stopped && !job->limits.nodes && wall_time() >= job->deadline)
+      stopped = TRUE;
+
+    job->running = TRUE;
+    pthread_mutex_unlock(&s->lock);
+
+    double start = wall_time();
+    if(!job->started && hex_search_start(job->engine, &job->limits)) {
+      /* The game is over: there's no move to report */
+      result.pv_length = 0;
+      result.move[0] = '\0';
+      finished = TRUE;
+    }
+    else if(stopped) {
+      hex_search_stop(job->engine, &result);
+      finished = TRUE;
+    }
+    else
+      finished = hex_search_step(job->engine, SLICE_NODES, &result);
+    job->started = TRUE;
+    double elapsed = wall_time() - start;
+
+    pthread_mutex_lock(&s->lock);
+    job->running = FALSE;
+
+    if(job->weight) {
+      job->vruntime += elapsed / job->weight;
+      s->min_vruntime = job->vruntime;
+      for(int k = 0; k < s->job_count; k++)
+        if(s->jobs[k]->weight && s->jobs[k]->vruntime < s->min_vruntime)
+          s->min_vruntime = s->jobs[k]->vruntime;
+    }
+
+    if(finished) {
+      /* The job leaves the scheduler before it reports, so the callback may submit again */
+      for(int k = 0; k < s->job_count; k++)
+        if(s->jobs[k] == job) {
+          s->jobs[k] = s->jobs[--s->job_count];
+          break;
+        }
+
+      pthread_mutex_unlock(&s->lock);
+      if(job->done)
+        job->done(job->engine, &result, job->data);
+      free(job);
+      pthread_mutex_lock(&s->lock);
+
+      if(s->closing && !s->job_count)
+        pthread_cond_broadcast(&s->ready);
+    }
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+hex_scheduler *hex_scheduler_create(int threads) {
+  hex_scheduler *s;
+
+  if(threads < 1 || !(s = calloc(1, sizeof(hex_scheduler))))
+    return NULL;
+
+  if(!(s->threads = malloc(threads * sizeof(pthread_t)))) {
+    free(s);
+    return NULL;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->ready, NULL);
+
+  for(s->thread_count = 0; s->thread_count < threads; s->thread_count++)
+    if(pthread_create(&s->threads[s->thread_count], NULL, worker, s))
+      break;
+
+  if(!s->thread_count) {
+    hex_scheduler_destroy(s);
+    return NULL;
+  }
+  return s;
+}
+
+void hex_scheduler_destroy(hex_scheduler *s) {
+  pthread_mutex_lock(&s->lock);
+  s->closing = TRUE;
+  for(int k = 0; k < s->job_count; k++)
+    s->jobs[k]->stopped = TRUE;
+  pthread_cond_broadcast(&s->ready);
+  pthread_mutex_unlock(&s->lock);
+
+  for(int t = 0; t < s->thread_count; t++)
+    pthread_join(s->threads[t], NULL);
+
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->ready);
+  free(s->jobs);
+  free(s->threads);
+  free(s);
+}
+
+int hex_scheduler_submit(hex_scheduler *s, hex_engine *e, const hex_limits *limits, int weight,
+                         hex_done done, void *data) {
+  job_t *job;
+  int error = HEX_NO_ERROR;
+
+  if(weight < 0)
+    return HEX_INVALID_ARGUMENT;
+  if(!(job = malloc(sizeof(job_t))))
+    return HEX_MEMALLOC_ERROR;
+
+  *job = (job_t) {e, limits ? *limits : (hex_limits) {0, 0}, weight, 0, 0, FALSE, FALSE, FALSE, done, data};
+  if(!job->limits.seconds)
+    job->limits.seconds = MOVE_TIME_LIMIT;
+  job->deadline = wall_time() + job->limits.seconds;
+
+  pthread_mutex_lock(&s->lock);
+  for(int k = 0; k < s->job_count; k++)
+    if(s->jobs[k]->engine == e)
+      error = HEX_SEARCH_IN_PROGRESS;
+
+  if(!error && s->job_count == s->job_size) {
+    int size = s->job_size ? 2*s->job_size : 64;
+    job_t **jobs = realloc(s->jobs, size * sizeof(job_t *));
+
+    if(jobs) {
+      s->jobs = jobs;
+      s->job_size = size;
+    }
+    else
+      error = HEX_MEMALLOC_ERROR;
+  }
+
+  if(!error) {
+    job->vruntime = s->job_count ? s->min_vruntime : 0;
+    s->jobs[s->job_count++] = job;
+    pthread_cond_signal(&s->ready);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  if(error)
+    free(job);
+  return error;
+}
+
+void hex_scheduler_stop(hex_scheduler *s, hex_engine *e) {
+  pthread_mutex_lock(&s->lock);
+  for(int k = 0; k < s->job_count; k++)
+    if(s->jobs[k]->engine == e) {
+      s->jobs[k]->stopped = TRUE;
+      pthread_cond_signal(&s->ready);
+    }
+  pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hex.h"
+#include "grid.h"
+#include "directives.h"
+#include "solver.h"
+
+#define COL_0 0x0101010101010101ULL
+#define COL_7 0x8080808080808080ULL
+
+typedef struct solver_entry {
+  uint64_t white, black;
+  uint64_t carrier; /* The empty cells the result depends on */
+  uint32_t info; /* mover (bit 30), mover wins (bit 29), best move (bits 0-7) */
+  uint32_t generation; /* The table's generation when the entry was stored (0: never) */
+} solver_entry;
+
+/* The solver's state is per thread, so that engines on different threads can solve at once. */
+/* Clearing the table starts a new generation, which leaves every stored entry stale, and the */
+/* key frees a thread's table when it exits */
+static _Thread_local solver_entry *table = NULL;
+static _Thread_local uint32_t generation = 1;
+static pthread_key_t table_key;
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+/* Masks and move ordering for the grid size being solved */
+static _Thread_local int solver_dimension = 0;
+static _Thread_local uint64_t board, top, bottom, left, right;
+static _Thread_local int order[SOLVER_MAX_DIMENSION*SOLVER_MAX_DIMENSION], order_cnt;
+
+static _Thread_local long nodes, max_nodes;
+static _Thread_local double deadline; /* If set, the solver also gives up at this wall_time() */
+static _Thread_local long history[64]; /* How often each cell has won a position, weighted by the subtree's size */
+
+void to_bitboard(bitboard_t *bb) {
+  bb->dimension = game.dimension;
+  bb->white = bb->black = 0;
+
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++) {
+      if(game.grid[i][j] == 'w')
+        bb->white |= 1ULL << (i*8 + j);
+      else if(game.grid[i][j] == 'b')
+        bb->black |= 1ULL << (i*8 + j);
+    }
+}
+
+/* Computes the masks and the move ordering (centre first) for an n x n grid */
+static void setup(int n) {
+  if(n == solver_dimension)
+    return;
+
+  solver_dimension = n;
+  board = top = bottom = left = right = 0;
+  for(int k = 0; k < n; k++) {
+    top |= 1ULL << k;
+    bottom |= 1ULL << ((n-1)*8 + k);
+    left |= 1ULL << (k*8);
+    right |= 1ULL << (k*8 + n-1);
+    for(int j = 0; j < n; j++)
+      board |= 1ULL << (k*8 + j);
+  }
+
+  /* Cells sorted by their (doubled) hex distance from the centre, ties keeping the row-major order */
+  order_cnt = 0;
+  for(int d = 0; d <= 4*n; d++)
+    for(int i = 0; i < n; i++)
+      for(int j = 0; j < n; j++)
+        if(abs(2*i - (n-1)) + abs(2*j - (n-1)) + abs(2*(i+j) - 2*(n-1)) == d)
+          order[order_cnt++] = i*8 + j;
+
+  solver_clear();
+}
+
+void solver_clear(void) {
+  memset(history, 0, sizeof(history));
+
+  /* Once the generations wrap around, the entries' are reset */
+  if(!++generation) {
+    if(table)
+      memset(table, 0, sizeof(solver_entry) << SOLVER_TT_BITS);
+    generation = 1;
+  }
+}
+
+/* Grows <set> through the stones of <own> until it stops changing */
+static uint64_t spread(uint64_t set, uint64_t own) {
+  uint64_t previous;
+
+  do {
+    previous = set;
+    set |= ((set & ~COL_0) >> 1) | ((set & ~COL_7) << 1) /* Left, right */
+         | (set >> 8) | (set << 8)                       /* Up, down */
+         | ((set & ~COL_7) >> 7) | ((set & ~COL_0) << 7); /* Up-right, down-left */
+    set &= own;
+  } while(set != previous);
+
+  return set;
+}
+
+static bool has_won(uint64_t stones, Colour player) {
+  if(player == W)
+    return (spread(stones & top, stones) & bottom) != 0;
+  return (spread(stones & left, stones) & right) != 0;
+}
+
+static solver_entry *slot(uint64_t white, uint64_t black, Colour mover) {
+  uint64_t h = (white * 0x9E3779B97F4A7C15ULL) ^ (black * 0xC2B2AE3D27D4EB4FULL) ^ mover;
+  return &table[(h ^ (h >> 29)) & ((1u << SOLVER_TT_BITS) - 1)];
+}
+
+/* Negamax over won/lost values: returns 1 if <mover> wins, 0 if not, -1 if the node limit was hit.
+ * The proof's carrier, the empty cells whose contents the result depends on, is stored in <carrier>.
+ * Stones outside a carrier never change the result, which lets a losing mover skip most moves: once
+ * a move x is refuted with carrier C, every move outside C is refuted too (the opponent simply
+ * treats it as x), so only the cells in the intersection of the carriers found so far (the
+ * "mustplay" region) are left to try */
+static int solve_node(uint64_t white, uint64_t black, Colour mover, int *best, uint64_t *carrier) {
+  if(++nodes > max_nodes || (deadline && !(nodes & DEADLINE_CHECK) && wall_time() >= deadline))
+    return -1;
+
+  solver_entry *entry = slot(white, black, mover);
+  if(entry->generation == generation && entry->white == white && entry->black == black && ((entry->info >> 30) & 1) == mover) {
+    *best = entry->info & 0xFF;
+    *carrier = entry->carrier;
+    return (entry->info >> 29) & 1;
+  }
+
+  uint64_t empty = board & ~(white | black);
+  uint64_t own = (mover == W) ? white : black, opp = (mover == W) ? black : white;
+  uint64_t threats = 0;
+  int result = 0, hardest = -1;
+  long hardest_nodes = -1;
+
+  /* A move that wins on the spot ends the search. Otherwise, the opponent's winning cells */
+  /* must be blocked: with two or more of them, the position is lost */
+  for(int k = 0; k < order_cnt; k++) {
+    uint64_t cell = 1ULL << order[k];
+    if(!(empty & cell))
+      continue;
+
+    if(has_won(own | cell, mover)) {
+      *best = order[k];
+      *carrier = cell;
+      result = 1;
+      goto store;
+    }
+    if(has_won(opp | cell, !mover))
+      threats |= cell;
+  }
+
+  if(threats & (threats-1)) {
+    *best = __builtin_ctzll(threats);
+    *carrier = threats;
+    goto store;
+  }
+
+  uint64_t mustplay = threats ? threats : empty;
+  *carrier = threats;
+
+  /* The candidates are tried in order of their history, ties keeping the centre-first order */
+  int moves[64], move_cnt = 0;
+  for(int k = 0; k < order_cnt; k++)
+    if(mustplay & (1ULL << order[k])) {
+      int m = move_cnt++;
+      for(; m > 0 && history[moves[m-1]] < history[order[k]]; m--)
+        moves[m] = moves[m-1];
+      moves[m] = order[k];
+    }
+
+  for(int k = 0; k < move_cnt; k++) {
+    uint64_t cell = 1ULL << moves[k], child_carrier;
+    if(!(mustplay & cell))
+      continue;
+
+    int reply;
+    long nodes_before = nodes;
+    int child = (mover == W) ? solve_node(white | cell, black, B, &reply, &child_carrier)
+                             : solve_node(white, black | cell, W, &reply, &child_carrier);
+    if(child < 0)
+      return -1;
+
+    if(!child) {
+      *best = moves[k];
+      *carrier = child_carrier | cell;
+      history[moves[k]] += nodes - nodes_before;
+      result = 1;
+      goto store;
+    }
+
+    mustplay &= child_carrier;
+    *carrier |= child_carrier | cell;
+
+    /* The reply that refuted this move is often the mover's key cell too: try it next */
+    for(int m = k+2; m < move_cnt; m++)
+      if(moves[m] == reply) {
+        memmove(moves+k+2, moves+k+1, (m-k-1) * sizeof(int));
+        moves[k+1] = reply;
+        break;
+      }
+
+    /* The position is lost so far: remember the move that took the longest to refute */
+    if(nodes - nodes_before > hardest_nodes) {
+      hardest_nodes = nodes - nodes_before;
+      hardest = moves[k];
+    }
+  }
+  *best = hardest;
+
+store:
+  entry->white = white;
+  entry->black = black;
+  entry->carrier = *carrier;
+  entry->info = ((uint32_t) mover << 30) | ((uint32_t) result << 29) | (*best & 0xFF);
+  entry->generation = generation;
+  return result;
+}
+
+static void create_table_key(void) {
+  pthread_key_create(&table_key, free);
+}
+
+/* The solver's table is allocated on first use: FALSE if it can't be */
+static bool table_ready(void) {
+  if(table)
+    return TRUE;
+  if(!(table = calloc((size_t) 1 << SOLVER_TT_BITS, sizeof(solver_entry))))
+    return FALSE;
+
+  pthread_once(&table_once, create_table_key);
+  pthread_setspecific(table_key, table);
+  return TRUE;
+}
+
+int solve(bitboard_t *bb, Colour mover, long node_limit, int *move, long *node_count) {
+  if(!table_ready())
+    return SOLVE_NO_MEMORY;
+
+  setup(bb->dimension);
+  nodes = 0;
+  max_nodes = node_limit;
+
+  uint64_t carrier;
+  int result = solve_node(bb->white, bb->black, mover, move, &carrier);
+  if(node_count)
+    *node_count = nodes;
+  return result;
+}
+
+/* The solved-position database */
+static void *map = NULL;
+static size_t map_size;
+
+bool solved_open(char *filename) {
+  sd_header header;
+  struct stat st;
+  int fd;
+
+  if((fd = open(filename, O_RDONLY)) < 0)
+    return FALSE;
+
+  if(fstat(fd, &st) < 0 || read(fd, &header, sizeof(header)) != sizeof(header)
+     || memcmp(header.magic, SD_MAGIC, 4) || header.version != SD_VERSION || header.table_count > SD_MAX_TABLES
+     || (size_t) st.st_size < sizeof(header) + header.table_count*sizeof(sd_table)) {
+    close(fd);
+    return FALSE;
+  }
+
+  map_size = st.st_size;
+  map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(map == MAP_FAILED) {
+    map = NULL;
+    return FALSE;
+  }
+
+  /* Every table must lie inside the file */
+  const sd_table *tables = (const sd_table *) ((char *) map + sizeof(header));
+  for(uint32_t t = 0; t < header.table_count; t++)
+    if(tables[t].offset % sizeof(uint64_t) || tables[t].offset > map_size
+       || tables[t].count > (map_size - tables[t].offset) / sizeof(uint64_t)) {
+      solved_close();
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+void solved_close(void) {
+  if(map)
+    munmap(map, map_size);
+  map = NULL;
+}
+
+/* Looks up the current position. On a hit, its best move is stored in <move> and its score */
+/* (INF if the player to move wins, -INF otherwise) in <score>. Positions missing from the */
+/* database are solved outright, if the grid is small enough and they have few empty cells, */
+/* unless the solver runs past <give_up> (a wall_time(), if it's set) */
+bool solved_probe(Move *move, int *score, double give_up) {
+  if(!map || game.dimension > SOLVER_MAX_DIMENSION)
+    return FALSE;
+
+  const sd_header *header = map;
+  const sd_table *tables = (const sd_table *) ((char *) map + sizeof(sd_header));
+  const uint64_t *entries = NULL;
+  uint64_t count = 0;
+
+  for(uint32_t t = 0; t < header->table_count; t++)
+    if(tables[t].dimension == (uint32_t) game.dimension) {
+      entries = (const uint64_t *) ((char *) map + tables[t].offset);
+      count = tables[t].count;
+    }
+
+  int transform;
+  uint64_t key = canonical_key(TRUE, &transform) >> 16;
+
+  /* The entries are sorted by key, which sits in their high bits */
+  uint64_t low = 0, high = count;
+  while(low < high) {
+    uint64_t mid = low + (high - low)/2;
+
+    if((entries[mid] >> 16) < key)
+      low = mid+1;
+    else
+      high = mid;
+  }
+
+  if(low < count && (entries[low] >> 16) == key) {
+    int cell = entries[low] & 0xFFF;
+    move->row = cell / MAX_DIMENSION;
+    move->col = cell % MAX_DIMENSION;
+    transform_cell(transform, &move->row, &move->col);
+
+    *score = (entries[low] & SD_WIN) ? INF : -INF;
+    return TRUE;
+  }
+
+  bitboard_t bb;
+  int cell;
+
+  to_bitboard(&bb);
+  if(game.dimension*game.dimension - __builtin_popcountll(bb.white | bb.black) > SOLVE_MAX_EMPTY)
+    return FALSE;
+
+  /* Without memory for the solver (or time for it), the position is simply searched */
+  deadline = give_up;
+  int result = solve(&bb, game.current_player, SOLVE_NODE_LIMIT, &cell, NULL);
+  deadline = 0;
+  if(result < 0 || cell < 0)
+    return FALSE;
+
+  move->row = cell / 8;
+  move->col = cell % 8;
+  *score = result ? INF : -INF;
+  return TRUE;
+}
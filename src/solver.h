@@ -0,0 +1,58 @@
+/* Exact solver for small grids (up to SOLVER_MAX_DIMENSION), and the solved-position database.
+ *
+ * The solver works on 64-bit bitboards (cell (row, col) is bit row*8 + col) and finds, for the
+ * player to move, whether the position is won and a move that wins it (or, if it's lost, the move
+ * that resists longest). Hex has no draws, so every position is one or the other.
+ *
+ * The database holds solved positions, keyed by canonical_key(TRUE, ..), in one sorted table per
+ * grid size. Layout (little-endian):
+ *   sd_header
+ *   sd_header.table_count sd_table entries
+ *   the tables' entries, each one a uint64:
+ *     bits 16-63: the key's 48 high bits
+ *     bit  15:    set if the player to move wins
+ *     bits 0-11:  the best move's cell (row*MAX_DIMENSION + col), in the canonical position's frame
+ */
+
+#define SOLVER_MAX_DIMENSION 8
+#define SOLVER_TT_BITS 21
+#define SOLVE_MAX_EMPTY 20 /* cont/suggest only try to solve positions with at most this many empty cells */
+#define SOLVE_NODE_LIMIT 500000 /* .. and give up after this many nodes */
+#define SOLVE_NO_MEMORY -2 /* solve()'s result when its table can't be allocated */
+#define DEADLINE_CHECK 1023 /* The solver checks its deadline (if it has one) every DEADLINE_CHECK+1 nodes */
+
+#define SD_MAGIC "HXSD"
+#define SD_VERSION 1
+#define SD_MAX_TABLES 8
+#define SD_WIN (1 << 15)
+
+typedef struct sd_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t table_count;
+  uint32_t reserved;
+} sd_header;
+
+typedef struct sd_table {
+  uint32_t dimension;
+  uint32_t reserved;
+  uint64_t count; /* Number of entries */
+  uint64_t offset; /* Byte offset of the first entry, from the start of the file */
+} sd_table;
+
+typedef struct bitboard_t {
+  int dimension;
+  uint64_t white, black;
+} bitboard_t;
+
+void to_bitboard(bitboard_t *); /* Converts game.grid into a bitboard */
+
+/* Solves a position for <mover>. Returns 1 if <mover> wins, 0 if they lose, -1 if the solver */
+/* exceeds <node_limit> nodes and SOLVE_NO_MEMORY if its table can't be allocated. The best */
+/* move's cell (row*8 + col) is stored in <move> */
+int solve(bitboard_t *, Colour, long, int *, long *);
+void solver_clear(void); /* Empties the solver's table (needed when the grid size changes) */
+
+bool solved_open(char *); /* Maps a solved-position database */
+void solved_close(void);
+bool solved_probe(Move *, int *, double); /* Looks up the current position: fills in the best move and its score (+-INF) */
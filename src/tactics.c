@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hex.h"
+#include "templates.h"
+#include "tactics.h"
+
+/* A player's view of the grid: their stones and the empty cells, by line of their frame (rows */
+/* for W, columns for B), where cell a of line l neighbours cells a and a+1 of line l-1, a-1 and */
+/* a+1 of line l, and a-1 and a of line l+1 */
+typedef struct frame {
+  int n;
+  uint64_t own[MAX_DIMENSION], empty[MAX_DIMENSION];
+  uint64_t reach[2][MAX_DIMENSION]; /* The stones joined to each edge (TP_NEAR: line 0, TP_FAR: line n-1) */
+} frame;
+
+/* Grows <reach> to every stone of the frame's player joined to it */
+static void flood(const frame *f, uint64_t *reach) {
+  bool grown = TRUE;
+
+  while(grown) {
+    grown = FALSE;
+
+    for(int l = 0; l < f->n; l++) {
+      uint64_t x = reach[l], previous;
+
+      if(l > 0)
+        x |= (reach[l-1] | (reach[l-1] >> 1)) & f->own[l];
+      if(l < f->n-1)
+        x |= (reach[l+1] | (reach[l+1] << 1)) & f->own[l];
+
+      do {
+        previous = x;
+        x |= ((x << 1) | (x >> 1)) & f->own[l];
+      } while(x != previous);
+
+      if(x != reach[l]) {
+        reach[l] = x;
+        grown = TRUE;
+      }
+    }
+  }
+}
+
+/* The empty cells of line <l> next to <reach> (or to the edge, on the edge's line) */
+static uint64_t touching(const frame *f, const uint64_t *reach, int side, int l) {
+  uint64_t cells = (reach[l] << 1) | (reach[l] >> 1);
+
+  if(l > 0)
+    cells |= reach[l-1] | (reach[l-1] >> 1);
+  if(l < f->n-1)
+    cells |= reach[l+1] | (reach[l+1] << 1);
+  if(l == ((side == TP_NEAR) ? 0 : f->n-1))
+    cells = ~0ULL;
+  return cells & f->empty[l];
+}
+
+/* Lists the player's winning moves (as frame cells, line*n + bit), up to <max>; returns their count */
+static int winning_moves(const frame *f, int *cells, int max) {
+  int count = 0;
+
+  for(int l = 0; l < f->n; l++)
+    for(uint64_t wins = touching(f, f->reach[TP_NEAR], TP_NEAR, l) & touching(f, f->reach[TP_FAR], TP_FAR, l);
+        wins && count < max; wins &= wins-1)
+      cells[count++] = l*f->n + __builtin_ctzll(wins);
+  return count;
+}
+
+static void get_frame(frame *f, const stone_lines *lines, Colour player) {
+  int n = f->n = game.dimension;
+
+  for(int l = 0; l < n; l++) {
+    uint64_t mine = (player == W) ? lines->row[W][l] : lines->col[B][l];
+    uint64_t theirs = (player == W) ? lines->row[B][l] : lines->col[W][l];
+
+    f->own[l] = mine;
+    f->empty[l] = ~(mine | theirs) & ((n == 64) ? ~0ULL : (1ULL << n) - 1);
+  }
+
+  memset(f->reach, 0, sizeof(f->reach));
+  f->reach[TP_NEAR][0] = f->own[0];
+  f->reach[TP_FAR][n-1] = f->own[n-1];
+  flood(f, f->reach[TP_NEAR]);
+  flood(f, f->reach[TP_FAR]);
+}
+
+/* Plays the frame's player's stone at <cell> (which touches one of their edges' floods) */
+static void place(frame *f, int cell) {
+  int l = cell / f->n;
+  uint64_t bit = 1ULL << (cell % f->n);
+  bool joins[2] = {(touching(f, f->reach[TP_NEAR], TP_NEAR, l) & bit) != 0, (touching(f, f->reach[TP_FAR], TP_FAR, l) & bit) != 0};
+
+  f->own[l] |= bit;
+  f->empty[l] &= ~bit;
+  for(int side = TP_NEAR; side <= TP_FAR; side++)
+    if(joins[side]) {
+      f->reach[side][l] |= bit;
+      flood(f, f->reach[side]);
+    }
+}
+
+/* A frame cell as a grid cell (row*dimension + col) */
+static int grid_cell(Colour player, int cell, int n) {
+  return (player == W) ? cell : (cell % n)*n + cell / n;
+}
+
+int tactics(Colour player, int *cell) {
+  stone_lines lines;
+  frame mine, theirs;
+  int n = game.dimension, wins[2], threats[2], threat_count;
+
+  get_stone_lines(&lines);
+  get_frame(&mine, &lines, player);
+  get_frame(&theirs, &lines, !player);
+
+  if(winning_moves(&mine, wins, 1)) {
+    *cell = grid_cell(player, wins[0], n);
+    return TACTIC_WIN;
+  }
+
+  threat_count = winning_moves(&theirs, threats, 2);
+  if(threat_count == 2) {
+    *cell = grid_cell(!player, threats[0], n);
+    return TACTIC_LOST;
+  }
+
+  /* Only a move next to one of the player's edge floods can make new winning moves (and if the */
+  /* opponent has a winning move, only its cell is worth trying) */
+  for(int l = 0; l < n; l++) {
+    uint64_t candidates = touching(&mine, mine.reach[TP_NEAR], TP_NEAR, l) | touching(&mine, mine.reach[TP_FAR], TP_FAR, l);
+
+    for(; candidates; candidates &= candidates-1) {
+      int c = l*n + __builtin_ctzll(candidates);
+      frame after;
+
+      if(threat_count && grid_cell(player, c, n) != grid_cell(!player, threats[0], n))
+        continue;
+
+      after = mine;
+      place(&after, c);
+      if(winning_moves(&after, wins, 2) == 2) {
+        *cell = grid_cell(player, c, n);
+        return TACTIC_DOUBLE;
+      }
+    }
+  }
+
+  if(threat_count) {
+    *cell = grid_cell(!player, threats[0], n);
+    return TACTIC_BLOCK;
+  }
+  return TACTIC_NONE;
+}
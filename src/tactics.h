@@ -0,0 +1,14 @@
+/* Tactical pre-search: the positions whose move is decided by immediate threats, found from
+ * connectivity masks before any search. A player's stones are flooded from each of their edges,
+ * a line of cells at a time (lines as in templates.h), and the empty cells next to both floods
+ * (or to an edge, for the lines that touch it) are the player's winning moves. A move that
+ * leaves two winning moves is a double threat: the opponent can only block one of them.
+ */
+
+#define TACTIC_NONE   0 /* Nothing is forced */
+#define TACTIC_WIN    1 /* The cell wins at once */
+#define TACTIC_DOUBLE 2 /* The cell makes a double threat (and the opponent has no winning move) */
+#define TACTIC_LOST   3 /* The opponent has a double threat: the cell blocks one of its moves */
+#define TACTIC_BLOCK  4 /* The opponent has one winning move, the cell: every other move loses */
+
+int tactics(Colour, int *); /* Checks the position for the player to move, setting the cell it forces */
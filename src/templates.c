@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hex.h"
+#include "templates.h"
+
+/* The cells of a line: the lowest <dimension> bits */
+#define LINE_MASK(n) (((n) == 64) ? ~0ULL : (1ULL << (n)) - 1)
+
+void get_stone_lines(stone_lines *lines) {
+  memset(lines, 0, sizeof(stone_lines));
+
+  for(int i = 0; i < game.dimension; i++)
+    for(int j = 0; j < game.dimension; j++) {
+      if(game.grid[i][j] == ' ')
+        continue;
+
+      Colour colour = (game.grid[i][j] == 'w') ? W : B;
+      lines->row[colour][i] |= 1ULL << j;
+      lines->col[colour][j] |= 1ULL << i;
+    }
+}
+
+/* The stones of <colour> on line <k> from one of <player>'s edges (rows for W, columns for B) */
+static uint64_t line_stones(const stone_lines *lines, Colour player, int side, int k, Colour colour) {
+  int line = (side == TP_NEAR) ? k : game.dimension-1 - k;
+  return (player == W) ? lines->row[colour][line] : lines->col[colour][line];
+}
+
+const edge_template *match_template(const stone_lines *lines, Colour player, int side, int row, int col) {
+  int n = game.dimension;
+  int along = (player == W) ? col : row;
+  int depth = (player == W) ? row : col;
+
+  if(side == TP_FAR)
+    depth = n-1 - depth;
+  if(depth < 1 || depth > TP_MAX_DEPTH)
+    return NULL;
+
+  for(int t = 0; t < template_count; t++) {
+    const edge_template *template = &edge_templates[side][t];
+    bool intact = (template->depth == depth);
+
+    for(int k = 0; intact && k <= depth; k++) {
+      int first = along + template->offset[k];
+
+      intact = first >= 0 && first + template->width[k] <= n
+               && !((line_stones(lines, player, side, k, !player) >> first) & template->carrier[k]);
+    }
+
+    if(intact)
+      return template;
+  }
+
+  return NULL;
+}
+
+/* Grows <reached> (masks of <player>'s stones, by line of the player's frame, where cell a of */
+/* line l neighbours cells a and a+1 of line l-1 and cells a-1 and a of line l+1) to every stone */
+/* it's joined to by adjacency or by a bridge whose two carrier cells are empty. Overlapping */
+/* carriers are not told apart, so the joins are only likely ones */
+static void grow(uint64_t *reached, const uint64_t *own, const uint64_t *empty, int n) {
+  bool grown = TRUE;
+
+  while(grown) {
+    grown = FALSE;
+
+    for(int l = 0; l < n; l++) {
+      uint64_t x = reached[l], e = empty[l];
+      uint64_t above = (l > 0) ? empty[l-1] : 0, below = (l < n-1) ? empty[l+1] : 0;
+      uint64_t add[5] = {0}; /* Lines l-2 .. l+2 */
+
+      if(!x)
+        continue;
+
+      add[2] = (x << 1) | (x >> 1);
+      add[1] = x | (x << 1);
+      add[3] = x | (x >> 1);
+      add[0] = (x & above & (above >> 1)) << 1;
+      add[1] |= ((x & (above >> 1) & (e >> 1)) << 2) | ((x & (e << 1) & above) >> 1);
+      add[3] |= ((x & (e >> 1) & below) << 1) | ((x & (below << 1) & (e << 1)) >> 2);
+      add[4] = (x & below & (below << 1)) >> 1;
+
+      for(int d = 0; d < 5; d++) {
+        int k = l + d-2;
+
+        if(k >= 0 && k < n && (add[d] & own[k] & ~reached[k])) {
+          reached[k] |= add[d] & own[k];
+          grown = TRUE;
+        }
+      }
+    }
+  }
+}
+
+/* Sets, in <frame> (masks by line of the player's frame), the carrier cells of the templates */
+/* and bridges that join the stones in <reached> */
+static void join_carriers(const stone_lines *lines, Colour player, uint64_t reached[2][MAX_DIMENSION],
+                          const uint64_t *empty, uint64_t *frame) {
+  int n = game.dimension;
+
+  for(int side = TP_NEAR; side <= TP_FAR; side++)
+    for(int depth = 1; depth <= min(TP_MAX_DEPTH, n-1); depth++) {
+      int line = (side == TP_NEAR) ? depth : n-1 - depth;
+
+      for(uint64_t stones = reached[side][line]; stones; stones &= stones-1) {
+        int along = __builtin_ctzll(stones);
+        const edge_template *template = (player == W) ? match_template(lines, player, side, line, along)
+                                                      : match_template(lines, player, side, along, line);
+        if(!template)
+          continue;
+
+        for(int k = 0; k <= depth; k++)
+          frame[(side == TP_NEAR) ? k : n-1 - k] |= template->carrier[k] << (along + template->offset[k]);
+      }
+    }
+
+  /* Each bridge is seen from its lower stone only, in the 3 directions towards line 0 */
+  for(int l = 1; l < n; l++) {
+    uint64_t x = reached[TP_NEAR][l] | reached[TP_FAR][l], e = empty[l], above = empty[l-1];
+    uint64_t up = reached[TP_NEAR][l-1] | reached[TP_FAR][l-1];
+    uint64_t two_up = (l > 1) ? reached[TP_NEAR][l-2] | reached[TP_FAR][l-2] : 0;
+    uint64_t cond;
+
+    cond = x & above & (above >> 1) & (two_up >> 1);
+    frame[l-1] |= cond | (cond << 1);
+    cond = x & (above >> 1) & (e >> 1) & (up >> 2);
+    frame[l-1] |= cond << 1;
+    frame[l] |= cond << 1;
+    cond = x & (e << 1) & above & (up << 1);
+    frame[l-1] |= cond;
+    frame[l] |= cond >> 1;
+  }
+
+  for(int l = 0; l < n; l++)
+    frame[l] &= empty[l];
+}
+
+int virtual_reach(const stone_lines *lines, Colour player, uint64_t *carriers) {
+  int n = game.dimension, total = 0;
+  uint64_t own[MAX_DIMENSION], empty[MAX_DIMENSION], reached[2][MAX_DIMENSION], frame[MAX_DIMENSION] = {0};
+
+  /* The player's frame: rows for W, columns for B */
+  for(int l = 0; l < n; l++) {
+    own[l] = (player == W) ? lines->row[W][l] : lines->col[B][l];
+    empty[l] = ~((player == W) ? lines->row[W][l] | lines->row[B][l] : lines->col[W][l] | lines->col[B][l]) & LINE_MASK(n);
+  }
+
+  for(int side = TP_NEAR; side <= TP_FAR; side++) {
+    int edge_line = (side == TP_NEAR) ? 0 : n-1, farthest = -1;
+
+    /* The stones next to the edge, or connected to it by a template */
+    memset(reached[side], 0, sizeof(reached[side]));
+    reached[side][edge_line] = own[edge_line];
+    for(int depth = 1; depth <= min(TP_MAX_DEPTH, n-1); depth++) {
+      int line = (side == TP_NEAR) ? depth : n-1 - depth;
+
+      for(uint64_t stones = own[line]; stones; stones &= stones-1) {
+        int along = __builtin_ctzll(stones);
+
+        if((player == W) ? match_template(lines, player, side, line, along)
+                         : match_template(lines, player, side, along, line))
+          reached[side][line] |= 1ULL << along;
+      }
+    }
+
+    grow(reached[side], own, empty, n);
+
+    for(int l = 0; l < n; l++)
+      if(reached[side][l])
+        farthest = max(farthest, (side == TP_NEAR) ? l : n-1 - l);
+    total += farthest + 1;
+  }
+
+  for(int l = 0; l < n; l++)
+    if(reached[TP_NEAR][l] & reached[TP_FAR][l]) {
+      if(carriers) {
+        join_carriers(lines, player, reached, empty, frame);
+
+        memset(carriers, 0, n*sizeof(uint64_t));
+        for(int k = 0; k < n; k++)
+          if(player == W)
+            carriers[k] = frame[k];
+          else
+            for(uint64_t cells = frame[k]; cells; cells &= cells-1)
+              carriers[__builtin_ctzll(cells)] |= 1ULL << k;
+      }
+      return 2*n;
+    }
+  return total;
+}
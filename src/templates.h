@@ -0,0 +1,52 @@
+/* Edge templates: a stone and a carrier of cells between it and one of its player's edges, such
+ * that the stone is connected to the edge whatever the opponent plays, as long as the carrier
+ * holds none of the opponent's stones (its player answers each intrusion inside it).
+ *
+ * A template is described in its edge's frame: line k is the k-th line of cells from the edge
+ * (0: the cells that touch it), and the cells of a line are numbered along it, in grid order
+ * (columns for White's edges, rows for Black's). Each line's part of the carrier is a bitmask,
+ * so that matching a template at a stone takes one shift, AND and compare per line against the
+ * mask of the opponent's stones on that line. The top and left edges (TP_NEAR) see the cells
+ * along their lines in the opposite order from the bottom and right ones (TP_FAR), so each
+ * template is stored once for each kind of edge, in every one of its orientations.
+ *
+ * The tables are generated by templates_gen (a build step, see the Makefile) into
+ * template_tables.c, and the generator checks every template by solving its carrier.
+ */
+
+#define TP_MAX_DEPTH 2 /* The farthest line from the edge a template's stone is on (the 3rd row) */
+#define TP_LINES (TP_MAX_DEPTH + 1)
+#define TP_MAX_TEMPLATES 16
+
+#define TP_NEAR 0 /* The top edge (White's) or the left one (Black's) */
+#define TP_FAR  1 /* The bottom edge or the right one */
+
+typedef struct edge_template {
+  const char *name; /* Row of the stone (from the edge, starting at 1) and variant, eg. "IIIa" */
+  int depth; /* The stone's line */
+  int offset[TP_LINES]; /* Where each line's bit 0 lies along the line, relative to the stone */
+  int width[TP_LINES]; /* How many of each line's bits are used */
+  uint64_t carrier[TP_LINES]; /* Each line's carrier cells (the stone's cell included) */
+} edge_template;
+
+/* Templates by kind of edge, by increasing depth */
+extern const int template_count;
+extern const edge_template edge_templates[2][TP_MAX_TEMPLATES];
+
+/* The stones of a grid as bitmasks, one per line of each direction */
+typedef struct stone_lines {
+  uint64_t row[2][MAX_DIMENSION]; /* By colour: bit j of row[c][i] is set if cell (i, j) holds a stone of c */
+  uint64_t col[2][MAX_DIMENSION]; /* bit i of col[c][j] is set if cell (i, j) holds a stone of c */
+} stone_lines;
+
+void get_stone_lines(stone_lines *); /* Fills in the game grid's masks */
+
+/* The first template connecting <player>'s stone at (row, col) to the player's TP_NEAR or TP_FAR */
+/* edge (NULL if none does) */
+const edge_template *match_template(const stone_lines *, Colour, int, int, int);
+
+/* How many lines from each of <player>'s edges their stones reach through templates, bridges */
+/* and adjacent stones, summed over both edges: 2*dimension if the two edges are virtually joined, */
+/* in which case <carriers> (if not NULL, indexed like stone_lines.row) gets the empty cells that */
+/* the joins' templates and bridges carry */
+int virtual_reach(const stone_lines *, Colour, uint64_t *);
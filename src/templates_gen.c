@@ -0,0 +1,215 @@
+/* templates_gen: writes the edge-template tables of templates.h (as C source) to stdout
+ *
+ * The templates are drawn below in the frame of a near edge (the top one, as White sees it): line
+ * k is indented by k spaces, so that each cell touches the two cells above it. Every template is
+ * checked before it's written: the opponent, moving first and only inside the carrier, must
+ * never be able to cut the stone from the edge. Each one is then mirrored (the reflection that
+ * keeps the edge in place), and both versions are turned around for the far edges.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex.h"
+#include "templates.h"
+
+#define MAX_TEMPLATE_CELLS 32
+
+typedef struct shape {
+  const char *name;
+  const char *line[TP_LINES]; /* From the edge's line to the stone's ('S') */
+} shape;
+
+static const shape shapes[] = {
+  {"II",   {". .",
+            " S"}},
+  {"IIIa", {". . . .",
+            " . . .",
+            "  . S"}},
+};
+
+#define SHAPES (int) (sizeof(shapes) / sizeof(shapes[0]))
+
+/* A template's cells, relative to the stone: (line, position along it) */
+typedef struct cells {
+  const char *name;
+  int depth, count;
+  int cell[MAX_TEMPLATE_CELLS][2];
+} cells;
+
+static bool adjacent(const int *a, const int *b) {
+  int dl = b[0] - a[0], da = b[1] - a[1];
+  return (dl == 0 && abs(da) == 1) || (dl == -1 && (da == 0 || da == 1)) || (dl == 1 && (da == 0 || da == -1));
+}
+
+/* Checks whether the stone (cell 0) is joined to the edge by the stones marked in <own> */
+static bool joined(const cells *t, unsigned own) {
+  unsigned seen = 1, grown = 1;
+
+  while(grown) {
+    grown = 0;
+    for(int c = 0; c < t->count; c++)
+      if((seen >> c & 1))
+        for(int d = 0; d < t->count; d++)
+          if(!(seen >> d & 1) && (own >> d & 1) && adjacent(t->cell[c], t->cell[d])) {
+            seen |= 1u << d;
+            grown = 1;
+          }
+  }
+
+  for(int c = 0; c < t->count; c++)
+    if((seen >> c & 1) && t->cell[c][0] == 0)
+      return TRUE;
+  return FALSE;
+}
+
+/* Checks whether the stone stays joined to the edge, with the opponent to move, given the */
+/* player's and the opponent's stones in the carrier */
+static bool holds(const cells *t, unsigned own, unsigned other) {
+  unsigned all = (1u << t->count) - 1;
+
+  if(joined(t, own))
+    return TRUE;
+  if(!joined(t, all & ~other))
+    return FALSE;
+
+  for(int c = 1; c < t->count; c++) {
+    bool answered = FALSE;
+
+    if((own | other) >> c & 1)
+      continue;
+    for(int d = 1; d < t->count && !answered; d++)
+      answered = d != c && !((own | other) >> d & 1) && holds(t, own | 1u << d, other | 1u << c);
+    if(!answered)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void parse(const shape *s, cells *t) {
+  int stone[2] = {0, 0};
+
+  t->name = s->name;
+  t->depth = 0;
+  t->count = 1; /* Cell 0 is the stone */
+  for(int k = 0; k < TP_LINES && s->line[k]; k++)
+    for(int i = 0; s->line[k][i]; i++)
+      if(s->line[k][i] == 'S') {
+        stone[0] = t->depth = k;
+        stone[1] = (i - k) / 2;
+      }
+
+  for(int k = 0; k < TP_LINES && s->line[k]; k++)
+    for(int i = 0; s->line[k][i]; i++)
+      if(s->line[k][i] == '.') {
+        t->cell[t->count][0] = k;
+        t->cell[t->count++][1] = (i - k) / 2 - stone[1];
+      }
+  t->cell[0][0] = t->depth;
+  t->cell[0][1] = 0;
+}
+
+/* The reflection that keeps the edge in place maps position a of line k to -a - (k - depth) */
+static void mirror(const cells *t, cells *m) {
+  *m = *t;
+  for(int c = 0; c < t->count; c++)
+    m->cell[c][1] = -t->cell[c][1] - (t->cell[c][0] - t->depth);
+}
+
+/* Far edges number the cells of a line the other way round */
+static void turn(const cells *t, cells *f) {
+  *f = *t;
+  for(int c = 0; c < t->count; c++)
+    f->cell[c][1] = -t->cell[c][1];
+}
+
+static bool same(const cells *a, const cells *b) {
+  for(int c = 0; c < a->count; c++) {
+    bool found = FALSE;
+
+    for(int d = 0; d < b->count && !found; d++)
+      found = a->cell[c][0] == b->cell[d][0] && a->cell[c][1] == b->cell[d][1];
+    if(!found)
+      return FALSE;
+  }
+
+  return a->count == b->count;
+}
+
+static void print_template(const cells *t) {
+  int offset[TP_LINES], width[TP_LINES];
+  uint64_t carrier[TP_LINES] = {0};
+
+  for(int k = 0; k < TP_LINES; k++) {
+    int low = MAX_DIMENSION, high = -MAX_DIMENSION;
+
+    for(int c = 0; c < t->count; c++)
+      if(t->cell[c][0] == k) {
+        low = min(low, t->cell[c][1]);
+        high = max(high, t->cell[c][1]);
+      }
+    offset[k] = (low <= high) ? low : 0;
+    width[k] = (low <= high) ? high - low + 1 : 0;
+
+    for(int c = 0; c < t->count; c++)
+      if(t->cell[c][0] == k)
+        carrier[k] |= 1ULL << (t->cell[c][1] - low);
+  }
+
+  printf("  {\"%s\", %d, {", t->name, t->depth);
+  for(int k = 0; k < TP_LINES; k++)
+    printf("%s%d", k ? ", " : "", offset[k]);
+  printf("}, {");
+  for(int k = 0; k < TP_LINES; k++)
+    printf("%s%d", k ? ", " : "", width[k]);
+  printf("}, {");
+  for(int k = 0; k < TP_LINES; k++)
+    printf("%s0x%llx", k ? ", " : "", (unsigned long long) carrier[k]);
+  printf("}},\n");
+}
+
+int min(int a, int b) {
+  return (a < b) ? a : b;
+}
+
+int max(int a, int b) {
+  return (a > b) ? a : b;
+}
+
+int main(void) {
+  static cells near[TP_MAX_TEMPLATES];
+  int count = 0;
+
+  for(int s = 0; s < SHAPES; s++) {
+    cells t, m;
+
+    parse(&shapes[s], &t);
+    if(t.depth < 1 || t.depth > TP_MAX_DEPTH || !holds(&t, 1, 0)) {
+      fprintf(stderr, "templates_gen: %s is not a template\n", t.name);
+      return EXIT_FAILURE;
+    }
+
+    near[count++] = t;
+    mirror(&t, &m);
+    if(!same(&t, &m))
+      near[count++] = m;
+  }
+
+  printf("/* Generated by templates_gen: do not edit */\n\n#include \"hex.h\"\n#include \"templates.h\"\n");
+  printf("\nconst int template_count = %d;\n", count);
+  printf("\nconst edge_template edge_templates[2][TP_MAX_TEMPLATES] = {\n {\n");
+  for(int t = 0; t < count; t++)
+    print_template(&near[t]);
+  printf(" },\n {\n");
+  for(int t = 0; t < count; t++) {
+    cells f;
+
+    turn(&near[t], &f);
+    print_template(&f);
+  }
+  printf(" },\n};\n");
+
+  return 0;
+}
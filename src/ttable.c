@@ -0,0 +1,49 @@
+#include <stdlib.h>
+
+#include "hex.h"
+#include "ttable.h"
+
+/* Tables are indexed by the low bits of the Zobrist key. Their size doesn't */
+/* depend on the grid's dimension, so large grids only cost more misses */
+
+tt_table *tt_create(int bits) {
+  tt_table *table;
+
+  if(bits < 1 || bits > 40 || !(table = malloc(sizeof(tt_table))))
+    return NULL;
+
+  if(!(table->entries = calloc((size_t) 1 << bits, sizeof(tt_entry)))) {
+    free(table);
+    return NULL;
+  }
+
+  table->mask = ((uint64_t) 1 << bits) - 1;
+  return table;
+}
+
+void tt_free(tt_table *table) {
+  if(table)
+    free(table->entries);
+  free(table);
+}
+
+bool tt_probe(uint64_t key, int *lower, int *upper) {
+  tt_entry *entry = &engine->table->entries[key & engine->table->mask];
+  uint64_t check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+  uint64_t data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+
+  if((check ^ data) != key)
+    return FALSE;
+
+  *lower = (int) (uint32_t) data;
+  *upper = (int) (uint32_t) (data >> 32);
+  return TRUE;
+}
+
+void tt_store(uint64_t key, int lower, int upper) {
+  tt_entry *entry = &engine->table->entries[key & engine->table->mask];
+  uint64_t data = (uint32_t) lower | (uint64_t) (uint32_t) upper << 32;
+
+  __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+  __atomic_store_n(&entry->check, key ^ data, __ATOMIC_RELAXED);
+}
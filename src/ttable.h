@@ -0,0 +1,19 @@
+#define TT_BITS 18 /* An engine's own table holds 2^TT_BITS entries (16 bytes each, 4 per cache line) */
+
+typedef struct tt_entry {
+  uint64_t check; /* The position's Zobrist key ^ data (0 marks an empty slot) */
+  uint64_t data; /* Bounds of White's static evaluation of the position: the lower one in the low */
+                 /* 32 bits, the upper one in the high 32 bits (the same, once it's known exactly) */
+} tt_entry; /* Transposition table entry */
+
+/* A table may be shared by engines on different threads. Entries are written without locks: */
+/* a reader that sees a half-written (or concurrently written) entry just misses */
+typedef struct hex_table {
+  tt_entry *entries;
+  uint64_t mask; /* Number of entries - 1 (the size is a power of 2) */
+} tt_table;
+
+tt_table *tt_create(int); /* Allocates an empty table of 2^bits entries, returning NULL on failure */
+void tt_free(tt_table *);
+bool tt_probe(uint64_t, int *, int *); /* Looks up a position's evaluation bounds, returning TRUE on a hit */
+void tt_store(uint64_t, int, int); /* Stores a position's evaluation bounds, replacing the slot's old entry */
@@ -1,124 +1,46 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "hex.h"
 #include "directives.h"
 
-extern game_t game;
-extern Listptr first_move;
-
-/* Parses and processes Command Line Arguments */
-void process_CLA(int argc, char **argv) {
-  int argind;
-  for(argind = 1; argind < argc && argv[argind][0] == '-'; argind++) {
-    switch(argv[argind][1]) {
-      case 'n':
-        if(!argv[++argind]) {
-          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-          exit(EXIT_FAILURE);
-        }
-        
-        for(int i = 0; argv[argind][i] != '\0'; i++)
-          if(!is_digit(argv[argind][i])) {
-            fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-            exit(EXIT_FAILURE);
-          }
-
-        game.dimension = atoi(argv[argind]);
-        if(game.dimension < 4 || game.dimension > 26) {
-          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-          exit(EXIT_FAILURE);
-        }
-        break;
-
-      case 'd':
-        if(!argv[++argind]) {
-          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-          exit(EXIT_FAILURE);
-        }
-
-        for(int i = 0; argv[argind][i] != '\0'; i++)
-          if(!is_digit(argv[argind][i])) {
-            fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-            exit(EXIT_FAILURE);
-          }
-
-        if((game.difficulty = atoi(argv[argind])) < 1) {
-          fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-          exit(EXIT_FAILURE);
-        }
-        break;
-
-      case 'b':
-        game.user = B;
-        break;
-
-      case 's':
-        game.swap = ON;
-        break;
-
-      default:
-        fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-  }
-
-  /* Takes care of option-arguments not starting with '-' */
-  if(argind < argc) {
-    fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
-    exit(EXIT_FAILURE);
-  }
-
-  /* The game difficulty cannot exceed the maximum game-tree depth: game.dimension^2 */
-  if(game.difficulty > game.dimension*game.dimension) {
-    fprintf(stderr, "%s: Invalid game difficulty\n", argv[0]);
-    exit(EXIT_FAILURE);
-  }
-}
 
 void print_current_player(void) {
+  if(engine->quiet)
+    return;
+
   printf("%s player ", (game.current_player == W) ? "White" : "Black");
   printf("(%s) plays now\n", (game.current_player == game.user) ? "human" : "computer");
 }
 
-void skip_whitespace(void) {
-  unsigned token;
-  while(is_whitespace(token = getchar()));
-
-  ungetc(token, stdin);
-}
-
-bool valid_coordinates(int row, int col) {
-  return (row >= 0 && row < game.dimension && col >= 0 && col < game.dimension);
-}
-
-bool is_neighbour(int row, int col, char hex) {
-  return (valid_coordinates(row, col) && game.grid[row][col] == hex);
+/* Finds the transition (edge) cost from one hex to another (a border cell costs nothing, */
+/* but its cost is never read) */
+int transition_cost(int cell, Colour player) {
+  char unreachable_hex = (player == W) ? 'b' : 'w';
+  return (game.cells[cell] == unreachable_hex) ? INF : (game.cells[cell] == ' ');
 }
 
-/* Finds the transition (edge) cost from one hex to another */
-int transition_cost(int row, int col, Colour player) {
-  if(!valid_coordinates(row, col)) return -1;
+/* The cost matrix is indexed like game.cells: every cell but the first row (W) or column (B) */
+/* starts out unreachable */
+void init_cost_matrix(int *cost_matrix, Colour player) {
+  int n = game.dimension;
 
-  char unreachable_hex = (player == W) ? 'b' : 'w';
-  return (game.grid[row][col] == unreachable_hex) ? INF : (game.grid[row][col] == ' ');
-}
+  for(int c = 0; c < STRIDE(n)*STRIDE(n); c++)
+    cost_matrix[c] = INF;
 
-void init_cost_matrix(int **cost_matrix, Colour player) {
-  for(int k = 0; k < game.dimension; k++) {
+  for(int k = 0; k < n; k++) {
     if(player == W)
-      cost_matrix[0][k] = transition_cost(0, k, W);
+      cost_matrix[cell_of(0, k)] = transition_cost(cell_of(0, k), W);
     else
-      cost_matrix[k][0] = transition_cost(k, 0, B); 
+      cost_matrix[cell_of(k, 0)] = transition_cost(cell_of(k, 0), B);
   }
-  
-  for(int i = (player == W); i < game.dimension; i++)
-    for(int j = (player == B); j < game.dimension; j++)
-      cost_matrix[i][j] = INF;
 }
 
 void print_winner(int *path, int *p_ind) {
   int row, col;
+  char move[MAX_MOVE_STR];
 
   printf("%s player ", (game.current_player == W) ? "White" : "Black");
   printf("(%s) ", (game.current_player == game.user) ? "human" : "computer");
@@ -129,82 +51,121 @@ void print_winner(int *path, int *p_ind) {
     row = path[*p_ind] / game.dimension;
     col = path[*p_ind] % game.dimension;
 
-    printf("%c%d%c", col+'A', row+1, (*p_ind==0) ? '\n' : '-');
+    printf("%s%c", move_str(row, col, move), (*p_ind==0) ? '\n' : '-');
   }
 }
 
-/* Deallocates a dynamically allocated 2 dimensional char array */
-void dealloc_char(int argc, char **argv) {
-  for(int i = 0; i < argc; i++)
-    free(argv[i]);
-  free(argv);
-}
-
-/* Deallocates a dynamically allocated 2 dimensional bool array */
-void dealloc_bool(int argc, bool **argv) {
-  for(int i = 0; i < argc; i++)
-    free(argv[i]);
-  free(argv);
-}
-
-void print_error(int error) {
+/* The message describing an error index (NULL for unknown ones) */
+const char *error_message(int error) {
   switch(error) {
     case INVALID_MOVE:
-      fprintf(stderr, "Invalid move\n");
-      break;
+      return "Invalid move";
     case WRONG_PLAYER:
-      fprintf(stderr, "It's not your turn to make a move\n");
-      break;
+      return "It's not your turn to make a move";
     case OCCUPIED_POSITION:
-      fprintf(stderr, "Position occupied\n");
-      break;
+      return "Position occupied";
     case INVALID_DIRECTIVE:
-      fprintf(stderr, "Invalid directive\n");
-      break;
+      return "Invalid directive";
     case EMPTY_MOVE_LIST:
-      fprintf(stderr, "No moves have been played yet\n");
-      break;
+      return "No moves have been played yet";
     case NO_USER_MOVE_YET:
-      fprintf(stderr, "You need to make a move first\n");
-      break;
+      return "You need to make a move first";
     case UNAVAILABLE_SWAP:
-      fprintf(stderr, "swap directive is not available\n");
-      break;
+      return "swap directive is not available";
     case MEMALLOC_ERROR:
-      fprintf(stderr, "Memory allocation error\n");
-      break;
+      return "Memory allocation error";
     case STATEFILE_ERROR:
-      fprintf(stderr, "File cannot be opened\n");
-      break;
+      return "File cannot be opened";
     case INVALID_DIMENSION:
-      fprintf(stderr, "Invalid dimension\n");
-      break;
+      return "Invalid dimension";
     case UNAVAILABLE_SUGGEST:
-      fprintf(stderr, "suggest directive is not available\n");
-      break;
+      return "suggest directive is not available";
     case UNAVAILABLE_CONT:
-      fprintf(stderr, "cont directive is not available\n");
-      break;
+      return "cont directive is not available";
     case INVALID_DIFFICULTY:
-      fprintf(stderr, "Invalid game difficulty\n");
-      break;
+      return "Invalid game difficulty";
+    case WEIGHTS_ERROR:
+      return "Invalid evaluator weights file";
+    case GAME_OVER:
+      return "The game is over";
+    case SEARCH_IN_PROGRESS:
+      return "A search is in progress";
+    case UNAVAILABLE_STOP:
+      return "stop directive is not available";
+    case INVALID_PLY:
+      return "There is no such ply in the game's history";
+    case JOURNAL_ERROR:
+      return "The journal cannot be written";
   }
+
+  return NULL;
 }
 
-/* Reads input characters until '\n' is read (for error-handling) */
-void input_flush(void) {
-  unsigned token;
-  while((token = getchar()) != '\n');
+void print_error(int error) {
+  if(error_message(error))
+    fprintf(stderr, "%s\n", error_message(error));
 }
 
-bool is_whitespace(unsigned token) {
-  return (token == ' ' || token == '\t');
+/* Reads input characters until '\n' is read (for error-handling) */
+void input_flush(void) {
+  int token;
+  while((token = getchar()) != '\n' && token != EOF);
 }
 
 bool is_digit(unsigned token) {
   return (token >= '0' && token <= '9');
 }
 
+bool is_upper(unsigned token) {
+  return (token >= 'A' && token <= 'Z');
+}
+
+/* Writes the label of column <col> into <label>: A..Z, then AA..AZ, BA.. etc. */
+char *column_label(int col, char *label) {
+  int l_ind = 0;
+
+  if(col >= 26)
+    label[l_ind++] = 'A' + col/26 - 1;
+  label[l_ind++] = 'A' + col%26;
+  label[l_ind] = '\0';
+
+  return label;
+}
+
+/* Writes the string representation of a move (eg. "C5", "AB12") into <move> */
+char *move_str(int row, int col, char *move) {
+  int len = strlen(column_label(col, move));
+  snprintf(move + len, MAX_MOVE_STR - len, "%d", row+1);
+
+  return move;
+}
+
+/* Translates a move string into grid indeces, returning NO_ERROR or INVALID_MOVE */
+int parse_move(char *move, int *row, int *col) {
+  int strind = 0;
+
+  /* Reads the (one or two letter) column label */
+  if(!is_upper(move[strind]))
+    return INVALID_MOVE;
+  *col = move[strind++] - 'A';
+  if(is_upper(move[strind]))
+    *col = (*col+1)*26 + (move[strind++] - 'A');
+
+  /* Reads the row number */
+  if(!is_digit(move[strind]))
+    return INVALID_MOVE;
+  *row = 0;
+  do {
+    *row = *row*10 + (move[strind++] - '0');
+  } while(is_digit(move[strind]) && *row <= game.dimension);
+
+  if(move[strind] != '\0' || *row < 1 || *row > game.dimension || *col >= game.dimension)
+    return INVALID_MOVE;
+
+  *row -= 1;
+  return NO_ERROR;
+}
+
 /* Adds two distances returning infinite if either is infinite (idea from: Orestis Polychroniou) */
 int add(int a, int b) {
   return (a == INF || b == INF) ? INF : a + b;
@@ -220,6 +181,15 @@ int max(int a, int b) {
   return (b == INF || (a != INF && a < b)) ? b : a;
 }
 
+double wall_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* The time each level of the difficulty ladder allows for a move */
+const double level_seconds[LEVELS] = {0.1, 0.2, 0.5, 1.0, 2.0, 4.0, 8.0, 12.0, 18.0, 25.0};
+
 /* Calculates the optimal time limit for each of the computer's moves */
 double optimal_time_limit(double total_time_elapsed) {
   double total_time_remaining = TOTAL_TIME_LIMIT - total_time_elapsed;
@@ -237,59 +207,7 @@ double optimal_time_limit(double total_time_elapsed) {
   /* he will take more time, taking a small time delay into consideration as well (eg. */
   /* the time needed to terminate the minimax search) */
 
-  return ((game.dimension >= 11 && 2*game.dimension*game.dimension/3 >= move_count(first_move))
+  return ((game.dimension >= 11 && 2*game.dimension*game.dimension/3 >= engine->history.ply)
              ? MOVE_TIME_LIMIT / 3.0
              : MOVE_TIME_LIMIT - ((game.dimension > 11) ? 5.0 : 2.0));
 }
-
-/* Linked list utility functions */
-void insert_at_end(Listptr *ptraddr, Listptr *last_move, int row, int col) {
-  while(*ptraddr != NULL)
-    ptraddr = &((*ptraddr)->next_move);
-
-  if(!(*ptraddr = malloc(sizeof(Move)))) {
-    print_error(MEMALLOC_ERROR);
-    exit(EXIT_FAILURE);
-  }
-
-  (*ptraddr)->row = row;
-  (*ptraddr)->col = col;
-  (*ptraddr)->player_clr = game.current_player;
-  (*ptraddr)->next_move = NULL;
-
-  *last_move = *ptraddr;
-}
-
-void remove_last_node(Listptr *ptraddr, Listptr *last_move) {
-  Listptr new_last_move = NULL;
-  while((*ptraddr) != (*last_move)) {
-    new_last_move = *ptraddr;
-    ptraddr = &((*ptraddr)->next_move);
-  }
-
-  /* Delete last move */
-  Listptr temp = *ptraddr;
-  *ptraddr = (*ptraddr)->next_move;
-  free(temp);
-
-  *last_move = new_last_move;
-}
-
-void delete_move_list(Listptr *ptraddr) {
-  if(!(*ptraddr))
-    return;
-
-  delete_move_list(&((*ptraddr) -> next_move));
-  free(*ptraddr);
-}
-
-int move_count(Listptr list) {
-  int count = 0;
-
-  while(list) {
-    count++;
-    list = list->next_move;
-  }
-
-  return count;
-}